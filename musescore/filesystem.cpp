@@ -1,9 +1,13 @@
 #include "filesystem.hpp"
 
 #include <cstring>
-#include <fstream>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
 
 #include <global/io/ioretcodes.h>
@@ -15,6 +19,56 @@ using namespace xtz::io;
 using namespace mu;
 using namespace mu::io;
 
+//! NOTE Smaller files are read (a mapping costs more than a copy of a few pages)
+static const size_t MAP_MIN_SIZE = 64 * 1024;
+//! NOTE Over this the files are read, not mapped
+static const size_t MAP_MAX_TOTAL_SIZE = 512 * 1024 * 1024;
+
+static int64_t mtimeNs(const struct stat& st)
+{
+#ifdef __APPLE__
+    return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+static bool preadAll(int fd, uint8_t* data, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t n = ::pread(fd, data + offset, size - offset, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            // truncated while reading
+            return false;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
 static bool isFsAvalable()
 {
 #ifdef PLATFORM_WEB
@@ -35,8 +89,8 @@ Ret FileSystem::exists(const path_t& path) const
         return make_ret(Ret::Code::NotSupported);
     }
 
-    std::ifstream f(path.c_str());
-    if (f.good()) {
+    struct stat st = {};
+    if (::stat(path.c_str(), &st) == 0) {
         return make_ret(Err::NoError);
     }
 
@@ -131,10 +185,14 @@ RetVal<uint64_t> FileSystem::fileSize(const path_t& path) const
 
     RetVal<uint64_t> rv;
 
-    std::ifstream in(path.toStdString(), std::ifstream::ate | std::ifstream::binary);
-    uint64_t size = in.tellg();
+    struct stat st = {};
+    if (::stat(path.c_str(), &st) != 0) {
+        rv.val = 0;
+        rv.ret = make_ret(Err::FSNotExist);
+        return rv;
+    }
 
-    rv.val = static_cast<uint64_t>(size);
+    rv.val = static_cast<uint64_t>(st.st_size);
     rv.ret = make_ok();
     return rv;
 }
@@ -217,11 +275,6 @@ RetVal<ByteArray> FileSystem::readFile(const path_t& filePath) const
 
 bool FileSystem::readFile(const path_t& filePath, ByteArray& data) const
 {
-    if (!exists(filePath)) {
-        LOGE() << "failed read, not exists: " << filePath;
-        return false;
-    }
-
     if (isResourcePath(filePath)) {
         return resourceReadFile(filePath, data);
     }
@@ -231,16 +284,74 @@ bool FileSystem::readFile(const path_t& filePath, ByteArray& data) const
         return false;
     }
 
-    std::ifstream ifs(filePath.c_str(), std::ios::binary);
+    //! NOTE Single open, the size is taken from the opened file
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE() << "failed read, not exists: " << filePath << ", err: " << std::strerror(errno);
+        return false;
+    }
+
+    struct stat st = {};
+    bool ok = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (ok) {
+        Mapping m;
+        m.dev = static_cast<uint64_t>(st.st_dev);
+        m.ino = static_cast<uint64_t>(st.st_ino);
+        m.mtime = mtimeNs(st);
+        m.size = static_cast<size_t>(st.st_size);
+
+        if (m.size >= MAP_MIN_SIZE && mapFile(filePath, fd, m, data)) {
+            ok = true;
+        } else {
+            ByteArray buf;
+            buf.resize(m.size);
+            ok = preadAll(fd, buf.data(), buf.size());
+            if (ok) {
+                data = buf;
+            }
+        }
+    }
 
-    size_t size = static_cast<size_t>(fileSize(filePath).val);
-    data.resize(size);
+    ::close(fd);
 
-    if (!ifs.read((char*)data.data(), data.size())) {
+    if (!ok) {
         LOGE() << "failed read: " << filePath;
+    }
+
+    return ok;
+}
+
+bool FileSystem::mapFile(const path_t& filePath, int fd, const Mapping& file, ByteArray& data) const
+{
+    std::lock_guard<std::mutex> lock(m_mappingsMutex);
+
+    Mapping& m = m_mappings[filePath.toStdString()];
+    if (m.data && m.dev == file.dev && m.ino == file.ino && m.mtime == file.mtime && m.size == file.size) {
+        data = ByteArray::fromRawData(m.data, m.size);
+        return true;
+    }
+
+    //! NOTE The file is changed. The views of the previous content can still be in use
+    //! (FreeType faces, archives), so its mapping is kept and the new content is read
+    if (m.data) {
         return false;
     }
 
+    if (m_mappedSize + file.size > MAP_MAX_TOTAL_SIZE) {
+        return false;
+    }
+
+    void* p = ::mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        LOGW() << "failed map: " << filePath << ", err: " << std::strerror(errno) << ", will be read";
+        return false;
+    }
+
+    m = file;
+    m.data = static_cast<const uint8_t*>(p);
+    m_mappedSize += m.size;
+
+    data = ByteArray::fromRawData(m.data, m.size);
     return true;
 }
 
@@ -251,19 +362,73 @@ Ret FileSystem::writeFile(const path_t& filePath, const ByteArray& data) const
         return make_ret(Ret::Code::NotSupported);
     }
 
-    FILE* file = fopen(filePath.c_str(), "wb");
-    if (!file) {
-        LOGE() << "Failed to open to writing file: " << filePath;
+    struct stat st = {};
+    const bool exists = ::stat(filePath.c_str(), &st) == 0;
+
+    //! NOTE A file that is not mapped is written in place (keeps its mode, owner and links)
+    if (!exists || !isMapped(static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino))) {
+        int fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            LOGE() << "Failed to open to writing file: " << filePath << ", err: " << std::strerror(errno);
+            return make_ret(Err::FSWriteError);
+        }
+
+        bool ok = writeAll(fd, data.constData(), data.size());
+        ok = ::close(fd) == 0 && ok;
+        if (!ok) {
+            LOGE() << "Failed to write file: " << filePath << ", err: " << std::strerror(errno);
+            return make_ret(Err::FSWriteError);
+        }
+
+        return make_ok();
+    }
+
+    //! NOTE A mapped file is written to a temp file and renamed over the target of the path
+    //! (truncating a mapped file makes the access to its mapping crash), the mode and the owner are kept
+    std::string targetPath = filePath.toStdString();
+    if (char* real = ::realpath(targetPath.c_str(), nullptr)) {
+        targetPath = real;
+        std::free(real);
+    }
+
+    std::string tmpPath = targetPath + ".XXXXXX";
+    int fd = ::mkstemp(&tmpPath[0]);
+    if (fd < 0) {
+        LOGE() << "Failed to open to writing file: " << filePath << ", err: " << std::strerror(errno);
         return make_ret(Err::FSWriteError);
     }
 
-    fwrite(data.constData(), 1, data.size(), file);
+    // not an error if the owner can't be kept (not permitted for not root)
+    if (::fchown(fd, st.st_uid, st.st_gid) != 0) {
+        LOGD() << "failed keep owner: " << filePath;
+    }
 
-    fclose(file);
+    bool ok = ::fchmod(fd, st.st_mode & 07777) == 0
+              && writeAll(fd, data.constData(), data.size());
+    ok = ::close(fd) == 0 && ok;
+    ok = ok && ::rename(tmpPath.c_str(), targetPath.c_str()) == 0;
+
+    if (!ok) {
+        LOGE() << "Failed to write file: " << filePath << ", err: " << std::strerror(errno);
+        ::unlink(tmpPath.c_str());
+        return make_ret(Err::FSWriteError);
+    }
 
     return make_ok();
 }
 
+bool FileSystem::isMapped(uint64_t dev, uint64_t ino) const
+{
+    std::lock_guard<std::mutex> lock(m_mappingsMutex);
+    for (const auto& p : m_mappings) {
+        const Mapping& m = p.second;
+        if (m.data && m.dev == dev && m.ino == ino) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void FileSystem::setAttribute(const path_t& path, Attribute attribute) const
 {
     UNUSED(path);
@@ -1,6 +1,10 @@
 #ifndef XTZ_IO_FILESYSTEMBASE_H
 #define XTZ_IO_FILESYSTEMBASE_H
 
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
 #include <global/io/ifilesystem.h>
 
 namespace xtz::io {
@@ -46,6 +50,25 @@ protected:
     bool resourceExists(const mu::io::path_t& path) const;
     bool resourceReadFile(const mu::io::path_t& filePath, mu::ByteArray& data) const;
     mu::RetVal<mu::io::paths_t> resourceScanFiles(const mu::io::path_t& path) const;
+
+private:
+
+    struct Mapping {
+        uint64_t dev = 0;
+        uint64_t ino = 0;
+        int64_t mtime = 0;
+        size_t size = 0;
+        const uint8_t* data = nullptr;
+    };
+
+    bool mapFile(const mu::io::path_t& filePath, int fd, const Mapping& file, mu::ByteArray& data) const;
+    bool isMapped(uint64_t dev, uint64_t ino) const;
+
+    //! NOTE The read data of large files are views into the mappings, so the mappings are
+    //! never unmapped. A path is mapped once, a changed file is read (not mapped again)
+    mutable std::mutex m_mappingsMutex;
+    mutable std::unordered_map<std::string, Mapping> m_mappings;
+    mutable size_t m_mappedSize = 0;
 };
 }
 
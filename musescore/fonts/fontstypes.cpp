@@ -0,0 +1,110 @@
+#include "fontstypes.hpp"
+
+#include <deque>
+#include <cstring>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+
+#include "log.h"
+
+using namespace xtz::fonts;
+
+static inline uint64_t rotl(uint64_t v, int r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+uint64_t xtz::fonts::contentHash(const uint8_t* data, size_t size, uint64_t seed)
+{
+    static const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+
+    auto round = [](uint64_t acc, uint64_t v) {
+        return rotl(acc + v * P2, 31) * P1;
+    };
+
+    uint64_t lanes[4] = { seed + P1 + P2, seed + P2, seed, seed - P1 };
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        uint64_t v[4];
+        std::memcpy(v, data + i, sizeof(v));
+        lanes[0] = round(lanes[0], v[0]);
+        lanes[1] = round(lanes[1], v[1]);
+        lanes[2] = round(lanes[2], v[2]);
+        lanes[3] = round(lanes[3], v[3]);
+    }
+
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    h ^= static_cast<uint64_t>(size) * P1;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v = 0;
+        std::memcpy(&v, data + i, sizeof(v));
+        h = rotl(h ^ round(0, v), 27) * P1 + P2;
+    }
+
+    for (; i < size; ++i) {
+        h = rotl(h ^ (data[i] * P1), 11) * P2;
+    }
+
+    return hashMix(h);
+}
+
+namespace {
+struct FamilyTable {
+    //! NOTE deque, so references to names remain valid on insert
+    std::deque<std::string> names { std::string() };
+    //! NOTE Both the original and the lowercased spellings are mapped,
+    //! so for known spellings there is no lowercasing
+    std::unordered_map<std::string, uint32_t> ids { { std::string(), 0 } };
+    std::shared_mutex mutex;
+};
+
+FamilyTable& familyTable()
+{
+    static FamilyTable table;
+    return table;
+}
+}
+
+uint32_t xtz::fonts::internFamily(const std::string& family)
+{
+    FamilyTable& t = familyTable();
+
+    {
+        std::shared_lock<std::shared_mutex> lock(t.mutex);
+        auto it = t.ids.find(family);
+        if (it != t.ids.end()) {
+            return it->second;
+        }
+    }
+
+    std::string lower = mu::strings::toLower(family);
+
+    std::unique_lock<std::shared_mutex> lock(t.mutex);
+    auto it = t.ids.find(lower);
+    uint32_t id = 0;
+    if (it != t.ids.end()) {
+        id = it->second;
+    } else {
+        id = static_cast<uint32_t>(t.names.size());
+        t.names.push_back(lower);
+        t.ids.emplace(lower, id);
+    }
+
+    t.ids.emplace(family, id);
+
+    return id;
+}
+
+const std::string& xtz::fonts::familyName(uint32_t familyId)
+{
+    FamilyTable& t = familyTable();
+    std::shared_lock<std::shared_mutex> lock(t.mutex);
+    IF_ASSERT_FAILED(familyId < t.names.size()) {
+        return t.names.front();
+    }
+    return t.names[familyId];
+}
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 // mu
 #include "global/types/bytearray.h"
@@ -16,44 +17,68 @@ using glyph_idx_t = uint32_t;
 static constexpr double DPI_F = 5.0;
 static constexpr double DPI = 72.0 * DPI_F;
 
+inline size_t hashCombine(size_t seed, size_t v)
+{
+    return seed ^ (v + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+inline uint64_t hashMix(uint64_t v)
+{
+    // splitmix64 finalizer
+    v ^= v >> 30;
+    v *= 0xbf58476d1ce4e5b9ULL;
+    v ^= v >> 27;
+    v *= 0x94d049bb133111ebULL;
+    v ^= v >> 31;
+    return v;
+}
+
+//! NOTE Fast hash of a content (xxHash64-like rounds, 4 lanes of 8 bytes),
+//! not for security, for the keys of caches that must change with the content
+uint64_t contentHash(const uint8_t* data, size_t size, uint64_t seed = 0);
+
+//! NOTE Family names are interned into a global table (lowercased),
+//! so keys hold only the id and are compared and hashed as integers.
+//! 0 is the id of the empty family. Thread safe.
+uint32_t internFamily(const std::string& family);
+const std::string& familyName(uint32_t familyId);
+
 struct FontDataKey {
 public:
 
     FontDataKey() = default;
     FontDataKey(const std::string& fa)
-        : m_family(mu::strings::toLower(fa)), m_bold(false), m_italic(false) {}
+        : m_familyId(internFamily(fa)), m_bold(false), m_italic(false) {}
 
     FontDataKey(const std::string& fa, bool bo, bool it)
-        : m_family(mu::strings::toLower(fa)), m_bold(bo), m_italic(it) {}
+        : m_familyId(internFamily(fa)), m_bold(bo), m_italic(it) {}
 
-    inline bool valid() const { return !m_family.empty(); }
+    inline bool valid() const { return m_familyId != 0; }
 
-    const std::string& family() const { return m_family; }
+    const std::string& family() const { return familyName(m_familyId); }
+    uint32_t familyId() const { return m_familyId; }
     bool bold() const { return m_bold; }
     bool italic() const { return m_italic; }
 
     inline bool operator==(const FontDataKey& o) const
     {
-        return m_bold == o.m_bold && m_italic == o.m_italic && m_family == o.m_family;
+        return m_familyId == o.m_familyId && m_bold == o.m_bold && m_italic == o.m_italic;
     }
 
     inline bool operator!=(const FontDataKey& o) const { return !this->operator==(o); }
 
-    inline bool operator<(const FontDataKey& o) const
-    {
-        if (m_bold != o.m_bold) {
-            return m_bold < o.m_bold;
-        }
+    inline bool operator<(const FontDataKey& o) const { return packed() < o.packed(); }
 
-        if (m_italic != o.m_italic) {
-            return m_italic < o.m_italic;
-        }
-
-        return m_family < o.m_family;
+    //! NOTE family id << 2 | bold << 1 | italic
+    inline uint64_t packed() const
+    {
+        return (uint64_t(m_familyId) << 2) | (uint64_t(m_bold) << 1) | uint64_t(m_italic);
     }
 
+    inline size_t hash() const { return static_cast<size_t>(hashMix(packed())); }
+
 private:
-    std::string m_family;
+    uint32_t m_familyId = 0;
     bool m_bold = false;
     bool m_italic = false;
 };
@@ -93,6 +118,17 @@ struct FaceKey {
             return pixelSize < o.pixelSize;
         }
     }
+
+    //! NOTE data key (34 bits) << 30 | type (6 bits) << 24 | pixel size (24 bits),
+    //! unique for pixel sizes below 2^24
+    inline uint64_t packed() const
+    {
+        return (dataKey.packed() << 30)
+               | ((uint64_t(type) & 0x3F) << 24)
+               | (uint64_t(pixelSize) & 0xFFFFFF);
+    }
+
+    inline size_t hash() const { return static_cast<size_t>(hashMix(packed())); }
 };
 
 inline int pixelSizeForFont(const mu::draw::Font& f)
@@ -109,13 +145,65 @@ inline FaceKey faceKeyForFont(const mu::draw::Font& f)
     return FaceKey{ dataKeyForFont(f), f.type(), pixelSizeForFont(f) };
 }
 
+//! NOTE Font resolved by the fonts engine.
+//! Remains valid as long as the engine exists
+struct FontHandle {
+    const void* d = nullptr;
+
+    inline bool valid() const { return d != nullptr; }
+};
+
+struct SymMetrics {
+    char32_t code = 0;
+    bool inFont = false;
+    mu::RectF bbox;
+    double advance = 0.0;
+};
+
+enum class SdfFormat : uint8_t {
+    Sdf = 0,    // single channel, 1 byte per pixel
+    Msdf = 1,   // multi-channel, RGB, 3 bytes per pixel, the distance is the median of the channels
+};
+
+inline uint8_t sdfChannels(SdfFormat format)
+{
+    return format == SdfFormat::Msdf ? 3 : 1;
+}
+
 struct Sdf {
     mu::ByteArray bitmap;
     uint32_t width = 0;
     uint32_t height = 0;
+    SdfFormat format = SdfFormat::Sdf;
+    uint8_t channels = 1;
     float threshold = 0.;
 };
 
+//! NOTE Parameters of the SDF generation, set per font type.
+//! The bitmap size is chosen per glyph: the glyph bounds at the texel density
+//! plus the distance range on each side, so thin and wide glyphs do not carry whitespace.
+//! The size is clamped, a glyph larger than the max size gets a lower density.
+//! MSDF keeps the corners sharp, so it needs a much lower density
+struct SdfParams {
+    SdfFormat format = SdfFormat::Sdf;
+    uint32_t density = 112; // texels per em
+    uint32_t range = 8;     // distance range on each side, texels
+    uint32_t minSize = 16;  // of the bitmap side, texels
+    uint32_t maxSize = 128;
+
+    inline bool operator==(const SdfParams& o) const
+    {
+        return format == o.format && density == o.density && range == o.range
+               && minSize == o.minSize && maxSize == o.maxSize;
+    }
+
+    inline bool operator!=(const SdfParams& o) const { return !this->operator==(o); }
+};
+
+//! NOTE Version of the SDF generation (the layout and the kernel), a part of the render cache key.
+//! Increase when the output changes, so that the cached images are generated again
+static constexpr uint32_t SDF_GENERATOR_VERSION = 1;
+
 struct GlyphImage {
     mu::RectF rect;
     Sdf sdf;
@@ -123,6 +211,49 @@ struct GlyphImage {
     bool isNull() const { return rect.isNull(); }
 };
 
+//! NOTE Rect of a glyph image in an atlas page, texels
+struct AtlasRect {
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+
+    bool isEmpty() const { return width == 0 || height == 0; }
+};
+
+//! NOTE Glyph of the rendered text, its image is a rect of an atlas page.
+//! Valid while the atlas generation is the same (it changes on defragmentation)
+struct AtlasGlyph {
+    mu::RectF rect;             // as GlyphImage::rect
+    uint32_t page = 0;
+    AtlasRect texRect;          // empty for glyphs without image
+    uint32_t generation = 0;
+
+    bool isNull() const { return rect.isNull(); }
+};
+
+//! NOTE View of an atlas page, valid only in the read callback.
+//! The rows of a texel rect are as the rows of the SDF bitmap
+struct AtlasPage {
+    const uint8_t* data = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint8_t channels = 1;
+    SdfFormat format = SdfFormat::Sdf;
+    uint64_t revision = 0;      // changed when glyphs are added or the page grows, to reupload
+
+    bool isNull() const { return data == nullptr; }
+};
+
+inline mu::RectF atlasUvRect(const AtlasRect& r, const AtlasPage& page)
+{
+    if (page.width == 0 || page.height == 0) {
+        return mu::RectF();
+    }
+    return mu::RectF(double(r.x) / page.width, double(r.y) / page.height,
+                     double(r.width) / page.width, double(r.height) / page.height);
+}
+
 struct FontParams {
     std::string name;
     mu::draw::Font::Type type = mu::draw::Font::Type::Undefined;
@@ -132,4 +263,16 @@ struct FontParams {
 };
 }
 
+namespace std {
+template<>
+struct hash<xtz::fonts::FontDataKey> {
+    size_t operator()(const xtz::fonts::FontDataKey& k) const { return k.hash(); }
+};
+
+template<>
+struct hash<xtz::fonts::FaceKey> {
+    size_t operator()(const xtz::fonts::FaceKey& k) const { return k.hash(); }
+};
+}
+
 #endif // XTZ_FONTS_FONTSTYPES_HPP
@@ -2,6 +2,10 @@
 #define XTZ_FONTS_IFONTSENGINE_HPP
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <future>
+#include <functional>
 
 // mu
 #include "global/modularity/imoduleexport.h"
@@ -18,6 +22,10 @@ class IFontsEngine : MODULE_EXPORT_INTERFACE
 public:
     virtual ~IFontsEngine() = default;
 
+    //! NOTE Resolves the font once, so that it can then be queried
+    //! many times without resolving it again
+    virtual FontHandle resolve(const mu::draw::Font& f) const = 0;
+
     virtual double lineSpacing(const mu::draw::Font& f) const = 0;
     virtual double xHeight(const mu::draw::Font& f) const = 0;
     virtual double height(const mu::draw::Font& f) const = 0;
@@ -27,18 +35,61 @@ public:
     virtual bool inFontUcs4(const mu::draw::Font& f, char32_t ucs4) const = 0;
 
     virtual double horizontalAdvance(const mu::draw::Font& f, const char32_t& ch) const = 0;
-    virtual double horizontalAdvance(const mu::draw::Font& f, const std::u32string& text) const = 0;
+    virtual double horizontalAdvance(const mu::draw::Font& f, std::u32string_view text) const = 0;
 
     virtual mu::RectF boundingRect(const mu::draw::Font& f, const char32_t& ch) const = 0;
-    virtual mu::RectF boundingRect(const mu::draw::Font& f, const std::u32string& text) const = 0;
-    virtual mu::RectF tightBoundingRect(const mu::draw::Font& f, const std::u32string& text) const = 0;
+    virtual mu::RectF boundingRect(const mu::draw::Font& f, std::u32string_view text) const = 0;
+    virtual mu::RectF tightBoundingRect(const mu::draw::Font& f, std::u32string_view text) const = 0;
 
     // Score symbols
     virtual mu::RectF symBBox(const mu::draw::Font& f, char32_t ucs4) const = 0;
     virtual double symAdvance(const mu::draw::Font& f, char32_t ucs4) const = 0;
 
+    // Resolved font
+    virtual double lineSpacing(const FontHandle& h) const = 0;
+    virtual double xHeight(const FontHandle& h) const = 0;
+    virtual double height(const FontHandle& h) const = 0;
+    virtual double ascent(const FontHandle& h) const = 0;
+    virtual double descent(const FontHandle& h) const = 0;
+
+    virtual bool inFontUcs4(const FontHandle& h, char32_t ucs4) const = 0;
+
+    virtual double horizontalAdvance(const FontHandle& h, const char32_t& ch) const = 0;
+    virtual double horizontalAdvance(const FontHandle& h, std::u32string_view text) const = 0;
+
+    virtual mu::RectF boundingRect(const FontHandle& h, const char32_t& ch) const = 0;
+    virtual mu::RectF boundingRect(const FontHandle& h, std::u32string_view text) const = 0;
+    virtual mu::RectF tightBoundingRect(const FontHandle& h, std::u32string_view text) const = 0;
+
+    virtual mu::RectF symBBox(const FontHandle& h, char32_t ucs4) const = 0;
+    virtual double symAdvance(const FontHandle& h, char32_t ucs4) const = 0;
+
+    // Batch
+    //! NOTE The font is resolved once for the whole batch
+    virtual std::vector<SymMetrics> symMetrics(const mu::draw::Font& f, const std::vector<char32_t>& codes) const = 0;
+    virtual std::vector<SymMetrics> symMetrics(const FontHandle& h, const std::vector<char32_t>& codes) const = 0;
+
     // Draw
-    virtual std::vector<GlyphImage> render(const mu::draw::Font& f, const std::u32string& text) const = 0;
+    //! NOTE Set before rendering, by default single channel for all types (see SdfParams).
+    //! Removes the glyphs of the type from the atlas and can defragment it (changes the generation)
+    virtual void setSdfParams(mu::draw::Font::Type type, const SdfParams& params) = 0;
+    virtual SdfParams sdfParams(mu::draw::Font::Type type) const = 0;
+
+    //! NOTE The images of the glyphs are in the atlas pages,
+    //! the pages whose revision has changed since the last draw are to be reuploaded
+    virtual std::vector<AtlasGlyph> render(const mu::draw::Font& f, std::u32string_view text) const = 0;
+
+    virtual uint32_t atlasGeneration() const = 0;
+    virtual size_t atlasPagesCount() const = 0;
+    virtual bool readAtlasPage(uint32_t page, const std::function<void(const AtlasPage&)>& func) const = 0;
+    //! NOTE Repacks the atlas, if the removed glyphs and the packing waste are more than the given part of it.
+    //! Changes the generation, the glyphs rendered before must be rendered again
+    virtual bool defragmentAtlas(double minWasteRatio = 0.5) = 0;
+
+    //! NOTE Generates the images of the glyphs in the background (on the workers) into the render cache,
+    //! so that the following render does not generate them.
+    //! Empty codes - all glyphs of the font. The result is the number of the prewarmed glyphs
+    virtual std::shared_future<size_t> prewarm(const mu::draw::Font& f, const std::vector<char32_t>& codes = {}) const = 0;
 };
 }
 
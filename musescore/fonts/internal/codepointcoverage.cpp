@@ -0,0 +1,53 @@
+#include "codepointcoverage.hpp"
+
+#include "log.h"
+
+using namespace xtz::fonts;
+
+void CodepointCoverage::setGlyphCount(size_t glyphCount)
+{
+    m_reverse.resize(glyphCount, 0);
+}
+
+void CodepointCoverage::add(char32_t ucs4, glyph_idx_t idx)
+{
+    if (ucs4 == 0 || idx == 0) {
+        return;
+    }
+
+    IF_ASSERT_FAILED(ucs4 <= MAX_CODEPOINT) {
+        return;
+    }
+
+    uint16_t& page = m_pageIndex[ucs4 >> PAGE_BITS];
+    if (page == 0) {
+        IF_ASSERT_FAILED(m_pages.size() / PAGE_LEN <= UINT16_MAX) {
+            return;
+        }
+        page = static_cast<uint16_t>(m_pages.size() / PAGE_LEN);
+        m_pages.resize(m_pages.size() + PAGE_LEN, 0);
+    }
+
+    glyph_idx_t& slot = m_pages[(size_t(page) << PAGE_BITS) | (ucs4 & PAGE_MASK)];
+    if (slot == 0) {
+        ++m_count;
+    }
+    slot = idx;
+
+    if (idx < m_reverse.size() && m_reverse[idx] == 0) {
+        m_reverse[idx] = ucs4;
+    }
+}
+
+void CodepointCoverage::squeeze()
+{
+    m_pages.shrink_to_fit();
+    m_reverse.shrink_to_fit();
+}
+
+size_t CodepointCoverage::bytes() const
+{
+    return m_pageIndex.size() * sizeof(uint16_t)
+           + m_pages.size() * sizeof(glyph_idx_t)
+           + m_reverse.size() * sizeof(char32_t);
+}
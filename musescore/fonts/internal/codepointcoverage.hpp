@@ -0,0 +1,80 @@
+#ifndef XTZ_FONTS_CODEPOINTCOVERAGE_H
+#define XTZ_FONTS_CODEPOINTCOVERAGE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "fonts/fontstypes.hpp"
+
+namespace xtz::fonts {
+//! NOTE Codepoints covered by a face, built once from its cmap.
+//! Forward lookup (codepoint -> glyph) is a two-level page table,
+//! reverse lookup (glyph -> codepoint) is a dense array indexed by glyph.
+//! After building, it is not changed, so it can be read from any thread without locks.
+class CodepointCoverage
+{
+public:
+    CodepointCoverage() = default;
+
+    //! NOTE If a glyph is mapped from several codepoints, the first added is used for reverse lookup.
+    //! Glyphs not less than glyphCount are not added to the reverse table
+    void add(char32_t ucs4, glyph_idx_t idx);
+    void setGlyphCount(size_t glyphCount);
+    void squeeze();
+
+    bool contains(char32_t ucs4) const { return glyphIndex(ucs4) != 0; }
+
+    glyph_idx_t glyphIndex(char32_t ucs4) const
+    {
+        if (ucs4 > MAX_CODEPOINT) {
+            return 0;
+        }
+
+        uint16_t page = m_pageIndex[ucs4 >> PAGE_BITS];
+        return m_pages[(size_t(page) << PAGE_BITS) | (ucs4 & PAGE_MASK)];
+    }
+
+    char32_t charCode(glyph_idx_t idx) const
+    {
+        return idx < m_reverse.size() ? m_reverse[idx] : 0;
+    }
+
+    //! NOTE Calls func(ucs4, idx) for the covered codepoints in ascending order,
+    //! only the allocated pages are visited
+    template<typename Func>
+    void forEach(const Func& func) const
+    {
+        for (size_t hi = 0; hi < m_pageIndex.size(); ++hi) {
+            const uint16_t page = m_pageIndex[hi];
+            if (page == 0) {
+                continue;
+            }
+
+            const glyph_idx_t* slots = &m_pages[size_t(page) << PAGE_BITS];
+            for (char32_t lo = 0; lo < PAGE_LEN; ++lo) {
+                if (slots[lo] != 0) {
+                    func(static_cast<char32_t>((hi << PAGE_BITS) | lo), slots[lo]);
+                }
+            }
+        }
+    }
+
+    size_t size() const { return m_count; }
+    size_t bytes() const;
+
+private:
+    static constexpr char32_t MAX_CODEPOINT = 0x10FFFF;
+    static constexpr int PAGE_BITS = 8;
+    static constexpr char32_t PAGE_LEN = 1 << PAGE_BITS;
+    static constexpr char32_t PAGE_MASK = PAGE_LEN - 1;
+
+    // codepoint >> PAGE_BITS -> page number, page 0 is empty (all glyphs are 0)
+    std::vector<uint16_t> m_pageIndex = std::vector<uint16_t>((MAX_CODEPOINT >> PAGE_BITS) + 1, 0);
+    std::vector<glyph_idx_t> m_pages = std::vector<glyph_idx_t>(PAGE_LEN, 0);
+    std::vector<char32_t> m_reverse;
+    size_t m_count = 0;
+};
+}
+
+#endif // XTZ_FONTS_CODEPOINTCOVERAGE_H
@@ -1,5 +1,7 @@
 #include "fontfacedu.hpp"
 
+#include <algorithm>
+
 using namespace xtz::fonts;
 
 struct DummyGlyph {
@@ -10,10 +12,10 @@ struct DummyGlyph {
     msdfgen::Shape shape;
 };
 
-static const DummyGlyph& dummyGlyph()
+static DummyGlyph makeDummyGlyph()
 {
-    static DummyGlyph g;
-    if (g.textAdvance == 0) {
+    DummyGlyph g;
+    {
         using namespace msdfgen;
 
         g.textBbox = FBBox(0, -8064, 4160, 9728);
@@ -66,6 +68,13 @@ static const DummyGlyph& dummyGlyph()
     return g;
 }
 
+static const DummyGlyph& dummyGlyph()
+{
+    //! NOTE The initialization of a static local is thread safe
+    static const DummyGlyph g = makeDummyGlyph();
+    return g;
+}
+
 FontFaceDU::FontFaceDU(IFontFace* origin)
     : m_origin(origin)
 {
@@ -91,6 +100,11 @@ bool FontFaceDU::isSymbolMode() const
     return m_origin->isSymbolMode();
 }
 
+uint64_t FontFaceDU::contentHash() const
+{
+    return m_origin->contentHash();
+}
+
 f26dot6_t FontFaceDU::leading() const
 {
     return m_origin->leading();
@@ -111,18 +125,21 @@ f26dot6_t FontFaceDU::xHeight() const
     return m_origin->xHeight();
 }
 
-std::vector<GlyphPos> FontFaceDU::glyphs(const char32_t* text, int text_length) const
+void FontFaceDU::glyphs(const char32_t* text, int text_length, Glyphs& result) const
 {
-    std::vector<GlyphPos> glyphs = m_origin->glyphs(text, text_length);
-    std::vector<GlyphPos> ret;
-    ret.reserve(glyphs.size());
-    for (GlyphPos& gp : glyphs) {
-        if (gp.idx == 0) {
+    m_origin->glyphs(text, text_length, result);
+
+    //! NOTE The run can be shared, it is copied only if there is something to change
+    auto isNotFound = [](const GlyphPos& gp) { return gp.idx == 0; };
+    if (std::none_of(result.begin(), result.end(), isNotFound)) {
+        return;
+    }
+
+    for (GlyphPos& gp : result.detach()) {
+        if (isNotFound(gp)) {
             gp.x_advance = glyphAdvance(0); // dummy
         }
-        ret.push_back(gp);
     }
-    return ret;
 }
 
 glyph_idx_t FontFaceDU::glyphIndex(char32_t ucs4) const
@@ -135,6 +152,11 @@ char32_t FontFaceDU::findCharCode(glyph_idx_t idx) const
     return m_origin->findCharCode(idx);
 }
 
+const CodepointCoverage& FontFaceDU::coverage() const
+{
+    return m_origin->coverage();
+}
+
 FBBox FontFaceDU::glyphBbox(glyph_idx_t idx) const
 {
     if (idx == 0) {
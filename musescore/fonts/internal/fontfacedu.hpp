@@ -15,15 +15,17 @@ public:
 
     const FaceKey& key() const override;
     bool isSymbolMode() const override;
+    uint64_t contentHash() const override;
 
     f26dot6_t leading() const override;
     f26dot6_t ascent() const override;
     f26dot6_t descent() const override;
     f26dot6_t xHeight() const override;
 
-    std::vector<GlyphPos> glyphs(const char32_t* text, int text_length) const override;
+    void glyphs(const char32_t* text, int text_length, Glyphs& result) const override;
     glyph_idx_t glyphIndex(char32_t ucs4) const override;
     char32_t findCharCode(glyph_idx_t idx) const override;
+    const CodepointCoverage& coverage() const override;
 
     FBBox glyphBbox(glyph_idx_t idx) const override;
     f26dot6_t glyphAdvance(glyph_idx_t idx) const override;
@@ -2,12 +2,15 @@
 
 #include <unordered_map>
 #include <iostream>
+#include <mutex>
+#include <algorithm>
 
 // third
 #include "ft2build.h"
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
 #include FT_BBOX_H
+#include FT_ADVANCES_H
 #include FT_TRUETYPE_TABLES_H
 #include <hb-ft.h>
 
@@ -18,6 +21,8 @@
 #include "global/io/file.h"
 
 // xtz
+#include "codepointcoverage.hpp"
+
 #include "log.h"
 
 using namespace xtz::fonts;
@@ -28,7 +33,7 @@ static const hb_tag_t CligTag = HB_TAG('c', 'l', 'i', 'g'); // contextual ligatu
 static const hb_tag_t DligTag = HB_TAG('d', 'l', 'i', 'g'); // contextual ligature substitution
 static const hb_tag_t HligTag = HB_TAG('h', 'l', 'i', 'g'); // contextual ligature substitution
 
-static const std::vector<hb_feature_t> HB_FEATURES = {
+static const hb_feature_t HB_FEATURES[] = {
     { KernTag, 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END },
     { LigaTag, 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END },
     { CligTag, 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END },
@@ -36,16 +41,35 @@ static const std::vector<hb_feature_t> HB_FEATURES = {
     { HligTag, 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END }
 };
 
+static const unsigned int HB_FEATURES_COUNT = sizeof(HB_FEATURES) / sizeof(HB_FEATURES[0]);
+
+//! NOTE One buffer per thread, it is cleared and reused for each shaping,
+//! so that its memory is allocated only once
+static hb_buffer_t* _thread_hb_buffer()
+{
+    struct BufferHolder {
+        hb_buffer_t* buffer = hb_buffer_create();
+        ~BufferHolder() { hb_buffer_destroy(buffer); }
+    };
+
+    thread_local BufferHolder holder;
+    hb_buffer_clear_contents(holder.buffer);
+    return holder.buffer;
+}
+
 static FT_Library ftlib = nullptr;
+//! NOTE FT_New_Face and FT_Done_Face must not be called at the same time for one library
+static std::mutex ftlibMutex;
 static bool _init_ft()
 {
-    int error = 0;
-    if (!ftlib) {
+    static std::once_flag once;
+    static int error = 0;
+    std::call_once(once, []() {
         error = FT_Init_FreeType(&ftlib);
         if (!ftlib || error) {
             LOGE() << "init freetype library failed";
         }
-    }
+    });
     return error == 0;
 }
 
@@ -54,27 +78,196 @@ static bool _init_ft()
 #define TRUNC(x)    ((x) >> 6)
 #define ROUND(x)    (((x) + 32) & -64)
 
-struct xtz::fonts::GlyphMetrics
+//! NOTE Metrics of all glyphs of the face (for its mode), indexed by glyph index.
+//! Built once at load, so lookups are a plain array access without locks
+struct xtz::fonts::GlyphTables
 {
-    FBBox bbox;
-    FT_Fixed linearAdvance = 0;
+    std::vector<int32_t> advance; // f26dot6_t
+    std::vector<int32_t> x1;      // f26dot6_t, bbox left
+    std::vector<int32_t> y1;      // f26dot6_t, bbox top
+    std::vector<int32_t> x2;      // f26dot6_t, bbox right
+    std::vector<int32_t> y2;      // f26dot6_t, bbox bottom
+
+    size_t size() const { return advance.size(); }
+
+    void resize(size_t size)
+    {
+        advance.assign(size, 0);
+        x1.assign(size, 0);
+        y1.assign(size, 0);
+        x2.assign(size, 0);
+        y2.assign(size, 0);
+    }
 };
 
-struct xtz::fonts::SymbolMetrics
+static void _build_glyph_tables(FT_Face face, bool isSymbolMode, GlyphTables& t)
 {
-    glyph_idx_t idx = 0;
-    FT_BBox bbox;
-    FT_Fixed linearAdvance = 0;
-};
+    const FT_Long count = face->num_glyphs;
+    if (count <= 0) {
+        return;
+    }
 
-struct xtz::fonts::FData
+    t.resize(static_cast<size_t>(count));
+
+    //! NOTE Linear (not hinted) advances in 16.16 pixels, read in bulk from hmtx
+    std::vector<FT_Fixed> advances(static_cast<size_t>(count), 0);
+    if (FT_Get_Advances(face, 0, static_cast<FT_UInt>(count), FT_LOAD_NO_HINTING, advances.data()) != 0) {
+        LOGW() << "freetype: cannot get advances";
+    }
+
+    const FT_Fixed xScale = face->size->metrics.x_scale;
+    const FT_Fixed yScale = face->size->metrics.y_scale;
+
+    // glyph 0 is the missing glyph, it has no metrics
+    for (FT_Long i = 1; i < count; ++i) {
+        //! NOTE Only the outline in font units, without scaling and hinting
+        FT_BBox bb = { 0, 0, 0, 0 };
+        if (FT_Load_Glyph(face, static_cast<FT_UInt>(i), FT_LOAD_NO_SCALE) == 0
+            && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE) {
+            FT_Outline_Get_BBox(&face->glyph->outline, &bb);
+        }
+
+        bb.xMin = FT_MulFix(bb.xMin, xScale);
+        bb.xMax = FT_MulFix(bb.xMax, xScale);
+        bb.yMin = FT_MulFix(bb.yMin, yScale);
+        bb.yMax = FT_MulFix(bb.yMax, yScale);
+
+        if (isSymbolMode) {
+            //! NOTE Moved form MUE FontEngineFT::advance
+            //! double advance = linearHoriAdvance * dpi_f / 655360.0;
+            //! -> f26dot6_t advance = linearHoriAdvance * dpi_f * 64.0 / 655360.0;
+            //! -> dpi_f = 5.0 constant
+            //! -> f26dot6_t advance = linearHoriAdvance * 320.0 / 655360.0;
+            //! -> f26dot6_t advance = linearHoriAdvance / 2048;
+            t.advance[i] = static_cast<int32_t>(advances[i] / 2048);
+
+            //! NOTE Moved form MUE FontEngineFT::bbox
+            //! double m = 640.0 / dpi_f;
+            //! -> to FBBox (f26dot6_t) double m = (640.0 / dpi_f) * (1 / 64);
+            //! -> double m = 10.0 / dpi_f;
+            //! -> dpi_f = 5.0 constant
+            //! -> int m = 2;
+            const int m = 2;
+            t.x1[i] = static_cast<int32_t>(bb.xMin / m);
+            t.y1[i] = static_cast<int32_t>(-bb.yMax / m);
+            t.x2[i] = static_cast<int32_t>(bb.xMax / m);
+            t.y2[i] = static_cast<int32_t>(-bb.yMin / m);
+        } else {
+            t.advance[i] = static_cast<int32_t>(advances[i] >> 10);
+
+            // grid fitted, as the glyph slot metrics
+            t.x1[i] = static_cast<int32_t>(FLOOR(bb.xMin));
+            t.y1[i] = static_cast<int32_t>(-CEIL(bb.yMax));
+            t.x2[i] = static_cast<int32_t>(CEIL(bb.xMax));
+            t.y2[i] = static_cast<int32_t>(-FLOOR(bb.yMin));
+        }
+    }
+}
+
+static void _build_coverage(FT_Face face, CodepointCoverage& coverage)
+{
+    //! NOTE One pass over the charmap, instead of walking it for each reverse lookup
+    coverage.setGlyphCount(static_cast<size_t>(std::max(face->num_glyphs, FT_Long(0))));
+
+    FT_UInt gindex = 0;
+    FT_ULong charcode = FT_Get_First_Char(face, &gindex);
+    while (gindex != 0) {
+        coverage.add(static_cast<char32_t>(charcode), static_cast<glyph_idx_t>(gindex));
+        charcode = FT_Get_Next_Char(face, charcode, &gindex);
+    }
+
+    coverage.squeeze();
+}
+
+namespace {
+//! NOTE The font file data and the FT_Face on top of it.
+//! It is shared by all the faces (symbol and text mode) loaded from one file,
+//! each of them has only its own FT_Size and the metrics tables for its mode
+struct FontFile
 {
     mu::ByteArray fontData;
+    uint64_t contentHash = 0;
     FT_Face face = nullptr;
+    CodepointCoverage coverage;
+
+    //! NOTE key: y_ppem << 32 | glyph index
+    std::unordered_map<uint64_t, msdfgen::Shape> shapes;
+
+    //! NOTE FT_Face and hb_font (on top of it) are not thread safe,
+    //! so all access to them, the sizes and the shapes goes through this mutex
+    std::mutex mutex;
+
+    ~FontFile()
+    {
+        if (face) {
+            std::lock_guard<std::mutex> lock(ftlibMutex);
+            FT_Done_Face(face);
+        }
+    }
+};
+}
+
+static std::shared_ptr<FontFile> _load_font_file(const mu::io::path_t& path)
+{
+    static std::mutex filesMutex;
+    static std::unordered_map<std::string, std::weak_ptr<FontFile> > files;
+
+    std::lock_guard<std::mutex> lock(filesMutex);
+
+    const std::string key = path.toStdString();
+    auto it = files.find(key);
+    if (it != files.end()) {
+        if (std::shared_ptr<FontFile> file = it->second.lock()) {
+            return file;
+        }
+    }
+
+    std::shared_ptr<FontFile> file = std::make_shared<FontFile>();
+    {
+        mu::io::File f(path);
+        if (!f.open(mu::io::IODevice::ReadOnly)) {
+            return nullptr;
+        }
+
+        file->fontData = f.readAll();
+        file->contentHash = xtz::fonts::contentHash(file->fontData.constData(), file->fontData.size());
+    }
+
+    int rval = 0;
+    {
+        std::lock_guard<std::mutex> ftlock(ftlibMutex);
+        rval = FT_New_Memory_Face(ftlib, (FT_Byte*)file->fontData.constData(),
+                                  (FT_Long)file->fontData.size(), 0, &file->face);
+    }
+
+    if (rval) {
+        LOGE() << "freetype: cannot create face: " << path << ", rval: " << rval;
+        file->face = nullptr;
+        return nullptr;
+    }
+
+    _build_coverage(file->face, file->coverage);
+
+    files[key] = file;
+
+    return file;
+}
+
+struct xtz::fonts::FData
+{
+    std::shared_ptr<FontFile> file;
+    FT_Size size = nullptr;
     hb_font_t* hb_font = nullptr;
-    std::unordered_map<glyph_idx_t, GlyphMetrics> glyphsMetrics;
-    std::unordered_map<glyph_idx_t, SymbolMetrics> symbolMetrics;
+    GlyphTables tables;
     FT_Size_Metrics metrics;
+    ShapingCache shapingCache;
+    std::vector<std::pair<hb_segment_properties_t, hb_shape_plan_t*> > shapePlans;
+
+    // expect the file mutex to be locked
+    void activate() const
+    {
+        FT_Activate_Size(size);
+    }
 };
 
 FontFaceFT::FontFaceFT()
@@ -84,10 +277,19 @@ FontFaceFT::FontFaceFT()
 
 FontFaceFT::~FontFaceFT()
 {
+    for (auto& p : m_data->shapePlans) {
+        hb_shape_plan_destroy(p.second);
+    }
+
     if (m_data->hb_font) {
         hb_font_destroy(m_data->hb_font);
     }
-    FT_Done_Face(m_data->face);
+
+    if (m_data->size) {
+        std::lock_guard<std::mutex> lock(m_data->file->mutex);
+        FT_Done_Size(m_data->size);
+    }
+
     delete m_data;
 }
 
@@ -100,38 +302,44 @@ bool FontFaceFT::load(const FaceKey& key, const mu::io::path_t& path, bool isSym
     m_key = key;
     m_isSymbolMode = isSymbolMode;
 
-    {
-        mu::io::File file(path);
-        if (!file.open(mu::io::IODevice::ReadOnly)) {
-            return false;
-        }
-
-        m_data->fontData = file.readAll();
+    //! NOTE The file is set only if the face is loaded successfully,
+    //! the accessors check it and return nothing for a not loaded face
+    std::shared_ptr<FontFile> file = _load_font_file(path);
+    if (!file) {
+        return false;
     }
 
-    int rval = FT_New_Memory_Face(ftlib, (FT_Byte*)m_data->fontData.constData(),
-                                  (FT_Long)m_data->fontData.size(), 0, &m_data->face);
-    if (rval) {
-        LOGE() << "freetype: cannot create face: " << m_key.dataKey.family() << ", rval: " << rval;
+    std::lock_guard<std::mutex> lock(file->mutex);
+
+    if (FT_New_Size(file->face, &m_data->size) != 0) {
+        LOGE() << "freetype: cannot create size: " << m_key.dataKey.family();
+        m_data->size = nullptr;
         return false;
     }
 
+    m_data->activate();
+
     if (m_isSymbolMode) {
-        FT_Set_Pixel_Sizes(m_data->face, 0, int(m_key.pixelSize + .5));
+        FT_Set_Pixel_Sizes(file->face, 0, int(m_key.pixelSize + .5));
     } else {
-        FT_Set_Char_Size(m_data->face, to_f26d6(m_key.pixelSize), to_f26d6(m_key.pixelSize), 0, 0);
+        FT_Set_Char_Size(file->face, to_f26d6(m_key.pixelSize), to_f26d6(m_key.pixelSize), 0, 0);
 
         static FT_Matrix matrix;
         matrix.xx = 0x10000;
         matrix.yy = 0x10000;
         matrix.xy = 0;
         matrix.yx = 0;
-        FT_Set_Transform(m_data->face, &matrix, nullptr);
+        FT_Set_Transform(file->face, &matrix, nullptr);
 
-        m_data->hb_font = hb_ft_font_create(m_data->face, NULL);
+        //! NOTE hb_ft takes the scale from the active size
+        m_data->hb_font = hb_ft_font_create(file->face, NULL);
     }
 
-    m_data->metrics = m_data->face->size->metrics;
+    m_data->metrics = m_data->size->metrics;
+
+    _build_glyph_tables(file->face, m_isSymbolMode, m_data->tables);
+
+    m_data->file = file;
 
     return true;
 }
@@ -146,139 +354,143 @@ bool FontFaceFT::isSymbolMode() const
     return m_isSymbolMode;
 }
 
-std::vector<GlyphPos> FontFaceFT::glyphs(const char32_t* text, int text_length) const
+uint64_t FontFaceFT::contentHash() const
 {
-    if (text_length < 1) {
-        return std::vector<GlyphPos>();
+    return m_data->file ? m_data->file->contentHash : 0;
+}
+
+void FontFaceFT::glyphs(const char32_t* text, int text_length, Glyphs& glyphs) const
+{
+    if (text_length < 1 || !m_data->file) {
+        glyphs.buffer();
+        return;
     }
 
-    std::vector<GlyphPos> result;
     if (m_isSymbolMode) {
+        GlyphRun& result = glyphs.buffer();
+        result.reserve(text_length);
+        const GlyphTables& t = m_data->tables;
         for (int i = 0; i < text_length; ++i) {
-            glyph_idx_t idx = glyphIndex(text[i]);
-            SymbolMetrics* sm = symbolMetrics(idx);
-            IF_ASSERT_FAILED(sm) {
-                return std::vector<GlyphPos>();
+            glyph_idx_t idx = m_data->file->coverage.glyphIndex(text[i]);
+            IF_ASSERT_FAILED(idx != 0 && idx < t.size()) {
+                result.clear();
+                return;
             }
 
             GlyphPos p;
-            p.idx = sm->idx;
-            p.x_advance = sm->linearAdvance;
+            p.idx = idx;
+            p.x_advance = t.advance[idx];
 
             result.push_back(std::move(p));
         }
-    } else {
-        hb_buffer_t* hb_buffer = hb_buffer_create();
-        hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
+        return;
+    }
 
-        hb_buffer_add_utf32(hb_buffer, (uint32_t*)text, text_length, 0, -1);
-        hb_buffer_set_direction(hb_buffer, props.direction);
-        hb_buffer_set_script(hb_buffer, props.script);
+    //! NOTE The cache has its own lock, so hits don't wait for the face
+    ShapingCache::GlyphRunPtr run = m_data->shapingCache.find(text, text_length);
+    if (!run) {
+        run = shape(text, text_length);
+        m_data->shapingCache.insert(text, text_length, run);
+    }
 
-        hb_buffer_set_segment_properties(hb_buffer, &props);
-        hb_buffer_guess_segment_properties(hb_buffer);
+    //! NOTE The cached run is shared, not copied
+    glyphs.setRun(std::move(run));
+}
 
-        hb_shape(m_data->hb_font, hb_buffer, &HB_FEATURES[0], HB_FEATURES.size());
-        unsigned int len = hb_buffer_get_length(hb_buffer);
-        result.reserve(len);
+ShapingCache::GlyphRunPtr FontFaceFT::shape(const char32_t* text, int text_length) const
+{
+    std::lock_guard<std::mutex> lock(m_data->file->mutex);
+    m_data->activate();
 
-        hb_glyph_info_t* info = hb_buffer_get_glyph_infos(hb_buffer, NULL);
-        hb_glyph_position_t* pos = hb_buffer_get_glyph_positions(hb_buffer, NULL);
+    std::shared_ptr<ShapingCache::GlyphRun> result = std::make_shared<ShapingCache::GlyphRun>();
 
-        for (unsigned int i = 0; i < len; i++) {
-            result.push_back({ info[i].codepoint, static_cast<f26dot6_t>(pos[i].x_advance) });
-        }
+    hb_buffer_t* hb_buffer = _thread_hb_buffer();
+    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
 
-        hb_buffer_destroy(hb_buffer);
+    hb_buffer_add_utf32(hb_buffer, (uint32_t*)text, text_length, 0, -1);
+    hb_buffer_set_direction(hb_buffer, props.direction);
+    hb_buffer_set_script(hb_buffer, props.script);
+
+    hb_buffer_set_segment_properties(hb_buffer, &props);
+    hb_buffer_guess_segment_properties(hb_buffer);
+
+    hb_buffer_get_segment_properties(hb_buffer, &props);
+    hb_shape_plan_t* plan = shapePlan(props);
+    hb_shape_plan_execute(plan, m_data->hb_font, hb_buffer, HB_FEATURES, HB_FEATURES_COUNT);
+
+    unsigned int len = hb_buffer_get_length(hb_buffer);
+    result->reserve(len);
+
+    hb_glyph_info_t* info = hb_buffer_get_glyph_infos(hb_buffer, NULL);
+    hb_glyph_position_t* pos = hb_buffer_get_glyph_positions(hb_buffer, NULL);
+
+    for (unsigned int i = 0; i < len; i++) {
+        result->push_back({ info[i].codepoint, static_cast<f26dot6_t>(pos[i].x_advance) });
     }
 
     return result;
 }
 
-glyph_idx_t FontFaceFT::glyphIndex(char32_t ucs4) const
+ShapingCache::Stats FontFaceFT::shapingStats() const
 {
-    if (ucs4 == 0) {
-        return 0;
-    }
-
-    FT_UInt index = FT_Get_Char_Index(m_data->face, ucs4);
-    return static_cast<glyph_idx_t>(index);
+    return m_data->shapingCache.stats();
 }
 
-char32_t FontFaceFT::findCharCode(glyph_idx_t idx) const
+hb_shape_plan_t* FontFaceFT::shapePlan(const hb_segment_properties_t& props) const
 {
-    auto findC = [this](glyph_idx_t idx)
-    {
-        FT_UInt gindex = 0;
-        FT_ULong charcode = FT_Get_First_Char(m_data->face, &gindex);
-        if (gindex == idx) {
-            return charcode;
+    //! NOTE Usually there are only a few different properties (often one),
+    //! so a linear search is fast enough
+    for (const auto& p : m_data->shapePlans) {
+        if (hb_segment_properties_equal(&p.first, &props)) {
+            return p.second;
         }
+    }
 
-        while (gindex != 0)
-        {
-            charcode = FT_Get_Next_Char(m_data->face, charcode, &gindex);
-            if (gindex == idx) {
-                return charcode;
-            }
-        }
+    hb_shape_plan_t* plan = hb_shape_plan_create_cached(hb_font_get_face(m_data->hb_font), &props,
+                                                        HB_FEATURES, HB_FEATURES_COUNT, nullptr);
+    m_data->shapePlans.push_back({ props, plan });
+    return plan;
+}
 
-        return FT_ULong(0);
-    };
+glyph_idx_t FontFaceFT::glyphIndex(char32_t ucs4) const
+{
+    return m_data->file ? m_data->file->coverage.glyphIndex(ucs4) : 0;
+}
 
-    char32_t c = findC(idx);
+char32_t FontFaceFT::findCharCode(glyph_idx_t idx) const
+{
+    return m_data->file ? m_data->file->coverage.charCode(idx) : 0;
+}
 
-    // check
-    {
-        glyph_idx_t i = glyphIndex(c);
-        assert(i == idx);
+const CodepointCoverage& FontFaceFT::coverage() const
+{
+    static const CodepointCoverage empty;
+    if (!m_data->file) {
+        return empty;
     }
-
-    return c;
+    return m_data->file->coverage;
 }
 
 FBBox FontFaceFT::glyphBbox(glyph_idx_t idx) const
 {
-    if (isSymbolMode()) {
-        SymbolMetrics* sm = symbolMetrics(idx);
-        IF_ASSERT_FAILED(sm) {
-            return FBBox();
-        }
-        //! NOTE Moved form MUE FontEngineFT::bbox
-        //! double m = 640.0 / dpi_f;
-        //! -> to FBBox (f26dot6_t) double m = (640.0 / dpi_f) * (1 / 64);
-        //! -> double m = 10.0 / dpi_f;
-        //! -> dpi_f = 5.0 constant
-        //! -> int m = 2;
-        int m = 2;
-        FBBox bbox;
-        bbox.setCoords(sm->bbox.xMin / m, -sm->bbox.yMax / m,
-                       sm->bbox.xMax / m, -sm->bbox.yMin / m);
-        return bbox;
-    } else {
-        GlyphMetrics* gm = glyphMetrics(idx);
-        if (!gm) {
-            return FBBox();
-        }
-        return gm->bbox;
+    const GlyphTables& t = m_data->tables;
+    if (idx == 0 || idx >= t.size()) {
+        return FBBox();
     }
+
+    FBBox bbox;
+    bbox.setCoords(t.x1[idx], t.y1[idx], t.x2[idx], t.y2[idx]);
+    return bbox;
 }
 
 f26dot6_t FontFaceFT::glyphAdvance(glyph_idx_t idx) const
 {
-    if (isSymbolMode()) {
-        SymbolMetrics* sm = symbolMetrics(idx);
-        IF_ASSERT_FAILED(sm) {
-            return 0.0;
-        }
-        return sm->linearAdvance;
-    } else {
-        GlyphMetrics* gm = glyphMetrics(idx);
-        if (!gm) {
-            return 0.0;
-        }
-        return gm->linearAdvance;
+    const GlyphTables& t = m_data->tables;
+    if (idx == 0 || idx >= t.size()) {
+        return 0;
     }
+
+    return t.advance[idx];
 }
 
 const msdfgen::Shape& FontFaceFT::glyphShape(glyph_idx_t idx) const
@@ -286,26 +498,33 @@ const msdfgen::Shape& FontFaceFT::glyphShape(glyph_idx_t idx) const
     static const msdfgen::Shape null;
 
     FT_UInt index = static_cast<FT_UInt>(idx);
-    if (index == 0) {
+    if (index == 0 || !m_data->file) {
         return null;
     }
 
-    auto it = m_cache.find(idx);
-    if (it != m_cache.end()) {
+    FontFile* file = m_data->file.get();
+    std::lock_guard<std::mutex> lock(file->mutex);
+
+    //! NOTE The elements of unordered_map are not moved on insert,
+    //! so the returned reference remains valid without the lock
+    const uint64_t key = (uint64_t(m_data->metrics.y_ppem) << 32) | idx;
+    auto it = file->shapes.find(key);
+    if (it != file->shapes.end()) {
         return it->second;
     }
 
-    if (FT_Load_Glyph(m_data->face, index, FT_LOAD_DEFAULT) != 0) {
+    m_data->activate();
+    if (FT_Load_Glyph(file->face, index, FT_LOAD_DEFAULT) != 0) {
         return null;
     }
 
-    std::pair<glyph_idx_t, msdfgen::Shape> v;
-    v.first = idx;
-    v.second = msdfgen::loadGlyphSlot(m_data->face->glyph, nullptr);
+    std::pair<uint64_t, msdfgen::Shape> v;
+    v.first = key;
+    v.second = msdfgen::loadGlyphSlot(file->face->glyph, nullptr);
     v.second.normalize();
     v.second.inverseYAxis = true;
 
-    return m_cache.insert(std::move(v)).first->second;
+    return file->shapes.insert(std::move(v)).first->second;
 }
 
 f26dot6_t FontFaceFT::leading() const
@@ -329,79 +548,26 @@ f26dot6_t FontFaceFT::descent() const
 
 f26dot6_t FontFaceFT::xHeight() const
 {
-    TT_OS2* os2 = (TT_OS2*)FT_Get_Sfnt_Table(m_data->face, ft_sfnt_os2);
-    if (os2 && os2->sxHeight) {
-        f26dot6_t result = std::round(os2->sxHeight * m_data->face->size->metrics.y_ppem * 64.0 / (double)m_data->face->units_per_EM);
-        return result;
-    }
-
-    const glyph_idx_t glyph = glyphIndex('x');
-    GlyphMetrics* gm = glyphMetrics(glyph);
-    IF_ASSERT_FAILED(gm) {
+    FontFile* file = m_data->file.get();
+    if (!file) {
         return 0;
     }
-    return gm->bbox.height();
-}
-
-GlyphMetrics* FontFaceFT::glyphMetrics(glyph_idx_t idx) const
-{
-    if (m_data->glyphsMetrics.find(idx) != m_data->glyphsMetrics.end()) {
-        return &m_data->glyphsMetrics.at(idx);
-    }
-
-    FT_UInt index = static_cast<FT_UInt>(idx);
-    if (index == 0) {
-        return nullptr;
-    }
-
-    if (FT_Load_Glyph(m_data->face, index, FT_LOAD_DEFAULT) != 0) {
-        return nullptr;
-    }
-
-    FT_GlyphSlot slot = m_data->face->glyph;
 
-    GlyphMetrics& gm = m_data->glyphsMetrics[idx];
-
-    gm.bbox.setLeft(slot->metrics.horiBearingX);
-    gm.bbox.setTop(-slot->metrics.horiBearingY);
-    gm.bbox.setWidth(slot->metrics.width);
-    gm.bbox.setHeight(slot->metrics.height);
-
-    gm.linearAdvance = slot->linearHoriAdvance >> 10;
-
-    return &gm;
-}
-
-SymbolMetrics* FontFaceFT::symbolMetrics(glyph_idx_t idx) const
-{
-    if (m_data->symbolMetrics.find(idx) != m_data->symbolMetrics.end()) {
-        return &m_data->symbolMetrics.at(idx);
-    }
-
-    FT_UInt index = static_cast<FT_UInt>(idx);
-    if (index == 0) {
-        return nullptr;
-    }
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
 
-    if (FT_Load_Glyph(m_data->face, index, FT_LOAD_DEFAULT) != 0) {
-        return nullptr;
+        TT_OS2* os2 = (TT_OS2*)FT_Get_Sfnt_Table(file->face, ft_sfnt_os2);
+        if (os2 && os2->sxHeight) {
+            f26dot6_t result = std::round(os2->sxHeight * m_data->metrics.y_ppem * 64.0 / (double)file->face->units_per_EM);
+            return result;
+        }
     }
 
-    SymbolMetrics& sm = m_data->symbolMetrics[idx];
-
-    sm.idx = static_cast<glyph_idx_t>(index);
-
-    if (FT_Outline_Get_BBox(&m_data->face->glyph->outline, &sm.bbox) != 0) {
-        return nullptr;
+    const glyph_idx_t glyph = m_data->file->coverage.glyphIndex('x');
+    IF_ASSERT_FAILED(glyph != 0) {
+        return 0;
     }
 
-    //! NOTE Moved form MUE FontEngineFT::advance
-    //! double advance = linearHoriAdvance * dpi_f / 655360.0;
-    //! -> f26dot6_t advance = linearHoriAdvance * dpi_f * 64.0 / 655360.0;
-    //! -> dpi_f = 5.0 constant
-    //! -> f26dot6_t advance = linearHoriAdvance * 320.0 / 655360.0;
-    //! -> f26dot6_t advance = linearHoriAdvance / 2048;
-    sm.linearAdvance = m_data->face->glyph->linearHoriAdvance / 2048;
-
-    return &sm;
+    const GlyphTables& t = m_data->tables;
+    return t.y2[glyph] - t.y1[glyph];
 }
@@ -3,11 +3,14 @@
 
 // xtz
 #include "ifontface.hpp"
+#include "shapingcache.hpp"
+
+struct hb_shape_plan_t;
+struct hb_segment_properties_t;
 
 namespace xtz::fonts {
 struct FData;
-struct GlyphMetrics;
-struct SymbolMetrics;
+struct GlyphTables;
 class FontFaceFT : public IFontFace
 {
 public:
@@ -19,30 +22,34 @@ public:
 
     const FaceKey& key() const override;
     bool isSymbolMode() const override;
+    uint64_t contentHash() const override;
 
     f26dot6_t leading() const override;
     f26dot6_t ascent() const override;
     f26dot6_t descent() const override;
     f26dot6_t xHeight() const override;
 
-    std::vector<GlyphPos> glyphs(const char32_t* text, int text_length) const override;
+    void glyphs(const char32_t* text, int text_length, Glyphs& result) const override;
     glyph_idx_t glyphIndex(char32_t ucs4) const override;
     char32_t findCharCode(glyph_idx_t idx) const override;
+    const CodepointCoverage& coverage() const override;
 
     FBBox glyphBbox(glyph_idx_t idx) const override;
     f26dot6_t glyphAdvance(glyph_idx_t idx) const override;
 
     const msdfgen::Shape& glyphShape(glyph_idx_t idx) const override;
 
+    // For dev
+    ShapingCache::Stats shapingStats() const;
+
 private:
 
-    GlyphMetrics* glyphMetrics(glyph_idx_t idx) const;
-    SymbolMetrics* symbolMetrics(glyph_idx_t idx) const;
+    ShapingCache::GlyphRunPtr shape(const char32_t* text, int text_length) const;
+    hb_shape_plan_t* shapePlan(const hb_segment_properties_t& props) const;
 
     FaceKey m_key;
     bool m_isSymbolMode = false;
     FData* m_data = nullptr;
-    mutable std::unordered_map<glyph_idx_t, msdfgen::Shape> m_cache;
 };
 }
 
@@ -4,11 +4,9 @@
 #include <algorithm>
 
 // mu
-#include "global/serialization/zipreader.h"
 #include "global/stringutils.h"
 #include "global/io/buffer.h"
 #include "global/io/fileinfo.h"
-#include "global/containers.h"
 
 // xtz
 //#include "xtz_global/runtime.hpp"
@@ -23,7 +21,6 @@ FontFaceXT::FontFaceXT()
 
 FontFaceXT::~FontFaceXT()
 {
-    delete m_zip;
 }
 
 bool FontFaceXT::load(const FaceKey& key, const mu::io::path_t& path, bool isSymbolMode)
@@ -31,15 +28,48 @@ bool FontFaceXT::load(const FaceKey& key, const mu::io::path_t& path, bool isSym
     m_key = key;
     m_isSymbolMode = isSymbolMode;
 
-    m_zip = new mu::ZipReader(path);
-    if (!m_zip->exists()) {
+    m_data = loadFileData(path);
+    return m_data != nullptr;
+}
+
+std::shared_ptr<FontFaceXT::FileData> FontFaceXT::loadFileData(const mu::io::path_t& path)
+{
+    static std::mutex filesMutex;
+    static std::unordered_map<std::string, std::weak_ptr<FileData> > files;
+
+    std::lock_guard<std::mutex> lock(filesMutex);
+
+    const std::string key = path.toStdString();
+    auto it = files.find(key);
+    if (it != files.end()) {
+        if (std::shared_ptr<FileData> d = it->second.lock()) {
+            return d;
+        }
+    }
+
+    std::shared_ptr<FileData> d = std::make_shared<FileData>();
+    if (!doLoadFileData(d.get(), path)) {
+        return nullptr;
+    }
+
+    files[key] = d;
+
+    return d;
+}
+
+bool FontFaceXT::doLoadFileData(FileData* d, const mu::io::path_t& path)
+{
+    if (!d->zip.open(path)) {
         LOGE() << "not exists: " << path;
         return false;
     }
 
+    //! NOTE The whole file is mapped, so it is hashed in place
+    d->contentHash = xtz::fonts::contentHash(d->zip.data(), d->zip.size());
+
     // meta
     {
-        mu::ByteArray metaData = m_zip->fileData("meta.txt");
+        mu::ByteArray metaData = d->zip.fileData("meta.txt");
         if (metaData.empty()) {
             LOGE() << "meta is empty";
             return false;
@@ -66,13 +96,13 @@ bool FontFaceXT::load(const FaceKey& key, const mu::io::path_t& path, bool isSym
             } else if (name == "glyphs") {
                 glyphs = valStr;
             } else if (name == "leading") {
-                m_leading = std::stol(valStr);
+                d->leading = std::stol(valStr);
             } else if (name == "ascent") {
-                m_ascent = std::stol(valStr);
+                d->ascent = std::stol(valStr);
             } else if (name == "descent") {
-                m_descent = std::stol(valStr);
+                d->descent = std::stol(valStr);
             } else if (name == "xHeight") {
-                m_xHeight = std::stol(valStr);
+                d->xHeight = std::stol(valStr);
             } else {
                 LOGW() << "unknown param: " << name;
             }
@@ -81,8 +111,30 @@ bool FontFaceXT::load(const FaceKey& key, const mu::io::path_t& path, bool isSym
         LOGI() << "fxt version: " << ver << ", glyphs: " << glyphs << ", path: " << path;
     }
 
+    // chars
+    {
+        for (const xtz::io::ZipArchive::Entry& e : d->zip.entries()) {
+            mu::String name = mu::io::FileInfo(mu::io::path_t(e.path)).baseName();
+            if (name.empty()) {
+                continue;
+            }
+
+            if (!name.at(0).isDigit()) {
+                continue;
+            }
+
+            bool ok = false;
+            int code = name.toInt(&ok);
+            if (ok) {
+                d->coverage.add(static_cast<char32_t>(code), static_cast<glyph_idx_t>(code));
+            }
+        }
+
+        d->coverage.squeeze();
+    }
+
     // ligatures
-    mu::ByteArray ligaturesData = m_zip->fileData("ligatures.txt");
+    mu::ByteArray ligaturesData = d->zip.fileData("ligatures.txt");
     if (!ligaturesData.empty()) {
         std::string ligaturesStr(ligaturesData.constChar(), ligaturesData.size());
         std::vector<std::string> ligatureStrs;
@@ -112,10 +164,10 @@ bool FontFaceXT::load(const FaceKey& key, const mu::io::path_t& path, bool isSym
                 l.second.push_back(std::stoi(k));
             }
 
-            m_ligatures.push_back(l);
+            d->ligatures.push_back(l);
         }
 
-        std::sort(m_ligatures.begin(), m_ligatures.end(), [](const Ligature& l1, const Ligature& l2) {
+        std::sort(d->ligatures.begin(), d->ligatures.end(), [](const Ligature& l1, const Ligature& l2) {
             return l1.second.size() > l2.second.size();
         });
     }
@@ -133,24 +185,29 @@ bool FontFaceXT::isSymbolMode() const
     return m_isSymbolMode;
 }
 
+uint64_t FontFaceXT::contentHash() const
+{
+    return m_data ? m_data->contentHash : 0;
+}
+
 f26dot6_t FontFaceXT::leading() const
 {
-    return m_leading;
+    return m_data ? m_data->leading : 0;
 }
 
 f26dot6_t FontFaceXT::ascent() const
 {
-    return m_ascent;
+    return m_data ? m_data->ascent : 0;
 }
 
 f26dot6_t FontFaceXT::descent() const
 {
-    return m_descent;
+    return m_data ? m_data->descent : 0;
 }
 
 f26dot6_t FontFaceXT::xHeight() const
 {
-    return m_xHeight;
+    return m_data ? m_data->xHeight : 0;
 }
 
 void FontFaceXT::applyLigatures(std::vector<char32_t>& text, const Ligatures& ls)
@@ -175,13 +232,19 @@ void FontFaceXT::applyLigatures(std::vector<char32_t>& text, const Ligatures& ls
     }
 }
 
-std::vector<GlyphPos> FontFaceXT::glyphs(const char32_t* text, int text_length) const
+void FontFaceXT::glyphs(const char32_t* text, int text_length, Glyphs& glyphs) const
 {
-    std::vector<GlyphPos> result;
+    GlyphRun& result = glyphs.buffer();
+
+    if (!m_data) {
+        return;
+    }
 
-    std::vector<char32_t> data(text, text + text_length);
+    //! NOTE Per thread buffer, so that memory is not allocated every time
+    thread_local std::vector<char32_t> data;
+    data.assign(text, text + text_length);
 
-    applyLigatures(data, m_ligatures);
+    applyLigatures(data, m_data->ligatures);
 
     for (char32_t ch : data) {
         if (ch == 0) {
@@ -198,22 +261,17 @@ std::vector<GlyphPos> FontFaceXT::glyphs(const char32_t* text, int text_length)
 
         result.push_back(std::move(p));
     }
-
-    return result;
 }
 
 glyph_idx_t FontFaceXT::glyphIndex(char32_t ucs4) const
 {
-    if (!mu::contains(chars(), ucs4)) {
-        return 0;
-    }
-    return static_cast<glyph_idx_t>(ucs4);
+    return m_data ? m_data->coverage.glyphIndex(ucs4) : 0;
 }
 
 char32_t FontFaceXT::findCharCode(glyph_idx_t idx) const
 {
     char32_t ch = static_cast<char32_t>(idx);
-    if (!mu::contains(chars(), ch)) {
+    if (!m_data || !m_data->coverage.contains(ch)) {
         return 0;
     }
     return ch;
@@ -234,48 +292,43 @@ const msdfgen::Shape& FontFaceXT::glyphShape(glyph_idx_t idx) const
     return glyphData(idx).shape;
 }
 
-const std::set<char32_t>& FontFaceXT::chars() const
+const CodepointCoverage& FontFaceXT::coverage() const
 {
-    if (!m_chars.empty()) {
-        return m_chars;
+    static const CodepointCoverage empty;
+    if (!m_data) {
+        return empty;
     }
-
-    std::vector<mu::ZipReader::FileInfo> files = m_zip->fileInfoList();
-    for (const mu::ZipReader::FileInfo& fi : files) {
-        mu::String name = mu::io::FileInfo(fi.filePath).baseName();
-        if (name.empty()) {
-            continue;
-        }
-
-        if (!name.at(0).isDigit()) {
-            continue;
-        }
-
-        bool ok = false;
-        int code = name.toInt(&ok);
-        if (ok) {
-            m_chars.insert(static_cast<char32_t>(code));
-        }
-    }
-
-    return m_chars;
+    return m_data->coverage;
 }
 
 const FontFaceXT::GlyphData& FontFaceXT::glyphData(glyph_idx_t idx) const
 {
-    auto it = m_cache.find(idx);
-    if (it != m_cache.end()) {
-        return it->second;
+    //! NOTE The face is not loaded
+    if (!m_data) {
+        static const GlyphData null;
+        return null;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        auto it = m_data->cache.find(idx);
+        if (it != m_data->cache.end()) {
+            return it->second;
+        }
     }
 
-    mu::ByteArray data = m_zip->fileData(std::to_string(idx));
+    //! NOTE Inflated and parsed without the lock,
+    //! if several threads read the same glyph, the first one is cached
+    mu::ByteArray data = m_data->zip.fileData(std::to_string(idx));
     mu::io::Buffer buf(&data);
     buf.open(mu::io::IODevice::ReadOnly);
 
     std::pair<glyph_idx_t, GlyphData> v;
     v.first = idx;
     v.second.read(&buf);
-    return m_cache.insert(std::move(v)).first->second;
+
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    return m_data->cache.insert(std::move(v)).first->second;
 }
 
 namespace {
@@ -2,16 +2,16 @@
 #define XTZ_FONTS_FONTFACEXT_H
 
 #include <unordered_map>
+#include <mutex>
+#include <memory>
 
 // mu
 #include "global/io/iodevice.h"
 
 // xtz
+#include "io/ziparchive.hpp"
 #include "ifontface.hpp"
-
-namespace mu {
-class ZipReader;
-}
+#include "codepointcoverage.hpp"
 
 namespace xtz::fonts {
 class FontFaceXT : public IFontFace
@@ -37,22 +37,22 @@ public:
 
     const FaceKey& key() const override;
     bool isSymbolMode() const override;
+    uint64_t contentHash() const override;
 
     f26dot6_t leading() const override;
     f26dot6_t ascent() const override;
     f26dot6_t descent() const override;
     f26dot6_t xHeight() const override;
 
-    std::vector<GlyphPos> glyphs(const char32_t* text, int text_length) const override;
+    void glyphs(const char32_t* text, int text_length, Glyphs& result) const override;
     glyph_idx_t glyphIndex(char32_t ucs4) const override;
     char32_t findCharCode(glyph_idx_t idx) const override;
+    const CodepointCoverage& coverage() const override;
 
     FBBox glyphBbox(glyph_idx_t idx) const override;
     f26dot6_t glyphAdvance(glyph_idx_t idx) const override;
     const msdfgen::Shape& glyphShape(glyph_idx_t idx) const override;
 
-    const std::set<char32_t>& chars() const;
-
     using Ligature = std::pair<char32_t, std::vector<char32_t> >;
     using Ligatures = std::vector<Ligature>;
 
@@ -62,19 +62,33 @@ private:
 
     const GlyphData& glyphData(glyph_idx_t idx) const;
 
-    FaceKey m_key;
-    bool m_isSymbolMode = false;
-
-    mu::ZipReader* m_zip = nullptr;
-    f26dot6_t m_leading = -1;
-    f26dot6_t m_ascent = -1;
-    f26dot6_t m_descent = -1;
-    f26dot6_t m_xHeight = -1;
+    //! NOTE The file data is the same for symbol and text mode (glyph data has metrics for both),
+    //! so it is loaded once and shared by all the faces of one file
+    struct FileData {
+        //! NOTE Memory mapped, read from several threads without the lock
+        xtz::io::ZipArchive zip;
+        uint64_t contentHash = 0;
+        f26dot6_t leading = -1;
+        f26dot6_t ascent = -1;
+        f26dot6_t descent = -1;
+        f26dot6_t xHeight = -1;
+
+        Ligatures ligatures;
+
+        //! NOTE Built at load, glyph index is the char code
+        CodepointCoverage coverage;
+
+        //! NOTE Guards the lazy cache
+        std::mutex mutex;
+        std::unordered_map<glyph_idx_t, GlyphData> cache;
+    };
 
-    Ligatures m_ligatures;
+    static std::shared_ptr<FileData> loadFileData(const mu::io::path_t& path);
+    static bool doLoadFileData(FileData* d, const mu::io::path_t& path);
 
-    mutable std::set<char32_t> m_chars;
-    mutable std::unordered_map<glyph_idx_t, GlyphData> m_cache;
+    FaceKey m_key;
+    bool m_isSymbolMode = false;
+    std::shared_ptr<FileData> m_data;
 };
 }
 
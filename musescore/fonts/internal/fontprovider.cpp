@@ -1,5 +1,8 @@
 #include "fontprovider.hpp"
 
+#include <array>
+#include <memory>
+
 #include "log.h"
 
 using namespace xtz::fonts;
@@ -27,29 +30,90 @@ void FontProvider::insertSubstitution(const mu::String& from, const mu::String&
     UNUSED(to);
 }
 
+//! NOTE Decodes into a per thread buffer, which is reused,
+//! so that measuring of strings does not allocate memory every time
+static std::u32string_view toU32View(const mu::String& str)
+{
+    thread_local std::u32string buffer;
+    buffer.clear();
+
+    const size_t size = str.size();
+    for (size_t i = 0; i < size; ++i) {
+        const char16_t c = str.at(i).unicode();
+        if (c >= 0xD800 && c < 0xDC00 && (i + 1) < size) {
+            const char16_t low = str.at(i + 1).unicode();
+            if (low >= 0xDC00 && low < 0xE000) {
+                buffer.push_back(0x10000 + ((static_cast<char32_t>(c) - 0xD800) << 10) + (low - 0xDC00));
+                ++i;
+                continue;
+            }
+        }
+        buffer.push_back(static_cast<char32_t>(c));
+    }
+
+    return buffer;
+}
+
+FontHandle FontProvider::resolve(const mu::draw::Font& f) const
+{
+    //! NOTE Layout usually asks for many metrics of the same few fonts in a row,
+    //! so we remember the last resolved ones (per thread, so no lock is needed)
+    static constexpr size_t MEMO_SIZE = 4;
+
+    //! NOTE The handles point into the engine. The engine is held weakly: its control block
+    //! stays while the memo refers to it, so a new engine (even at the same address) does not match
+    struct Memo {
+        std::weak_ptr<IFontsEngine> engine;
+        std::array<mu::draw::Font, MEMO_SIZE> fonts;
+        std::array<FontHandle, MEMO_SIZE> handles;
+        size_t next = 0;
+    };
+
+    thread_local Memo memo;
+
+    std::shared_ptr<IFontsEngine> engine = fontsEngine();
+    if (memo.engine.owner_before(engine) || engine.owner_before(memo.engine)) {
+        memo = Memo();
+        memo.engine = engine;
+    }
+
+    for (size_t i = 0; i < MEMO_SIZE; ++i) {
+        if (memo.handles[i].valid() && memo.fonts[i] == f) {
+            return memo.handles[i];
+        }
+    }
+
+    FontHandle h = engine->resolve(f);
+    memo.fonts[memo.next] = f;
+    memo.handles[memo.next] = h;
+    memo.next = (memo.next + 1) % MEMO_SIZE;
+
+    return h;
+}
+
 double FontProvider::lineSpacing(const mu::draw::Font& f) const
 {
-    return fontsEngine()->lineSpacing(f);
+    return fontsEngine()->lineSpacing(resolve(f));
 }
 
 double FontProvider::xHeight(const mu::draw::Font& f) const
 {
-    return fontsEngine()->xHeight(f);
+    return fontsEngine()->xHeight(resolve(f));
 }
 
 double FontProvider::height(const mu::draw::Font& f) const
 {
-    return fontsEngine()->height(f);
+    return fontsEngine()->height(resolve(f));
 }
 
 double FontProvider::ascent(const mu::draw::Font& f) const
 {
-    return fontsEngine()->ascent(f);
+    return fontsEngine()->ascent(resolve(f));
 }
 
 double FontProvider::descent(const mu::draw::Font& f) const
 {
-    return fontsEngine()->descent(f);
+    return fontsEngine()->descent(resolve(f));
 }
 
 bool FontProvider::inFont(const mu::draw::Font& f, mu::Char ch) const
@@ -59,28 +123,28 @@ bool FontProvider::inFont(const mu::draw::Font& f, mu::Char ch) const
 
 bool FontProvider::inFontUcs4(const mu::draw::Font& f, char32_t ucs4) const
 {
-    return fontsEngine()->inFontUcs4(f, ucs4);
+    return fontsEngine()->inFontUcs4(resolve(f), ucs4);
 }
 
 // Text
 double FontProvider::horizontalAdvance(const mu::draw::Font& f, const mu::String& string) const
 {
-    return fontsEngine()->horizontalAdvance(f, string.toStdU32String());
+    return fontsEngine()->horizontalAdvance(resolve(f), toU32View(string));
 }
 
 double FontProvider::horizontalAdvance(const mu::draw::Font& f, const mu::Char& ch) const
 {
-    return fontsEngine()->horizontalAdvance(f, ch.unicode());
+    return fontsEngine()->horizontalAdvance(resolve(f), ch.unicode());
 }
 
 mu::RectF FontProvider::boundingRect(const mu::draw::Font& f, const mu::String& string) const
 {
-    return fontsEngine()->boundingRect(f, string.toStdU32String());
+    return fontsEngine()->boundingRect(resolve(f), toU32View(string));
 }
 
 mu::RectF FontProvider::boundingRect(const mu::draw::Font& f, const mu::Char& ch) const
 {
-    return fontsEngine()->boundingRect(f, ch.unicode());
+    return fontsEngine()->boundingRect(resolve(f), ch.unicode());
 }
 
 mu::RectF FontProvider::boundingRect(const mu::draw::Font& f, const mu::RectF& r, int flags, const mu::String& string) const
@@ -92,18 +156,18 @@ mu::RectF FontProvider::boundingRect(const mu::draw::Font& f, const mu::RectF& r
 
 mu::RectF FontProvider::tightBoundingRect(const mu::draw::Font& f, const mu::String& string) const
 {
-    return fontsEngine()->tightBoundingRect(f, string.toStdU32String());
+    return fontsEngine()->tightBoundingRect(resolve(f), toU32View(string));
 }
 
 // Score symbols
 mu::RectF FontProvider::symBBox(const mu::draw::Font& f, char32_t ucs4, double DPI_F) const
 {
     UNUSED(DPI_F);
-    return fontsEngine()->symBBox(f, ucs4);
+    return fontsEngine()->symBBox(resolve(f), ucs4);
 }
 
 double FontProvider::symAdvance(const mu::draw::Font& f, char32_t ucs4, double DPI_F) const
 {
     UNUSED(DPI_F);
-    return fontsEngine()->symAdvance(f, ucs4);
+    return fontsEngine()->symAdvance(resolve(f), ucs4);
 }
@@ -43,6 +43,10 @@ public:
     // Score symbols
     mu::RectF symBBox(const mu::draw::Font& f, char32_t ucs4, double DPI_F) const override;
     double symAdvance(const mu::draw::Font& f, char32_t ucs4, double DPI_F) const override;
+
+private:
+
+    FontHandle resolve(const mu::draw::Font& f) const;
 };
 }
 
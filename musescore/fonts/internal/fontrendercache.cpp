@@ -1,54 +1,60 @@
 #include "fontrendercache.hpp"
 
 #include <string>
-#include <iomanip>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
 
-#include "global/stringutils.h"
 #include "global/io/file.h"
-#include "global/io/fileinfo.h"
 #include "global/io/dir.h"
 
 //#include "xtz_global/io/io.hpp"
-//#include "xtz_global/version.h"
 
 #include "log.h"
 
 using namespace xtz::fonts;
 
+static const std::string PACK_FILE_NAME = "sdfcache.pack";
+
+//! NOTE The pack is compacted on init, if the live records are more, the oldest are dropped
+static const size_t MAX_PACK_SIZE = 256 * 1024 * 1024;
+
+//! NOTE The suffix of the keys of the current generator (see keyToString)
+static bool isCurrentGeneratorKey(std::string_view key)
+{
+    static const std::string suffix = "_v" + std::to_string(SDF_GENERATOR_VERSION);
+    return key.size() >= suffix.size() && key.substr(key.size() - suffix.size()) == suffix;
+}
+
 void FontRenderCache::init()
 {
-    // clean cache if need
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    //! NOTE The cache is not cleared on upgrade, the entries are keyed by the content of the font
+    //! and the generation params (see keyToString), so only the changed ones are not found
     if (isStoreToFS()) {
         const mu::io::path_t cachePath = cacheDirPath();
-        const mu::io::path_t revisionPath = cachePath + "revision";
-        bool isNeedClear = true;
-
-        // try read revision
-        if (mu::io::File::exists(revisionPath)) {
-            mu::io::File file(revisionPath);
-            file.open(mu::io::IODevice::ReadOnly);
-            mu::ByteArray data = file.readAll();
-            if (std::strcmp(data.constChar(), "xtz::Version::revision()") == 0) {
-                isNeedClear = false;
-            }
-        }
+        mu::io::Dir::mkpath(cachePath);
 
-        // clean if need
-        if (isNeedClear) {
-            mu::RetVal<mu::io::paths_t> files = mu::io::Dir::scanFiles(cachePath, {}, mu::io::ScanMode::FilesInCurrentDir);
+        // remove the files of the old cache (one file per glyph, the revision file)
+        {
+            mu::RetVal<mu::io::paths_t> files = mu::io::Dir::scanFiles(cachePath, { "*.sdf" }, mu::io::ScanMode::FilesInCurrentDir);
             for (const mu::io::path_t& p : files.val) {
                 mu::io::File::remove(p);
             }
-        }
 
-        mu::io::Dir::mkpath(cachePath);
+            const mu::io::path_t revisionPath = cachePath + "revision";
+            if (mu::io::File::exists(revisionPath)) {
+                mu::io::File::remove(revisionPath);
+            }
+        }
 
-        // write revision
-        {
-            mu::io::File file(revisionPath);
-            file.open(mu::io::IODevice::WriteOnly);
-            mu::ByteArray data = "xtz::Version::revision()";
-            file.write(data);
+        //! NOTE The records of the changed fonts and params are not found anymore, but stay in the pack,
+        //! so it is compacted before it is opened: the records of other generator versions are dropped,
+        //! and the oldest ones, if the pack is too large
+        if (!m_packsOpened) {
+            SdfPackFile::compact(packFilePath(), MAX_PACK_SIZE, isCurrentGeneratorKey);
         }
     }
 }
@@ -62,6 +68,34 @@ bool FontRenderCache::isStoreToFS() const
 #endif
 }
 
+FontRenderCache::Reader::Reader(const FontRenderCache& cache)
+    : m_cache(cache)
+{
+    m_cache.m_readers.fetch_add(1, std::memory_order_acq_rel);
+}
+
+FontRenderCache::Reader::~Reader()
+{
+    if (m_cache.m_readers.fetch_sub(1, std::memory_order_acq_rel) == 1
+        && m_cache.m_hasRetiredPacks.load(std::memory_order_acquire)) {
+        m_cache.closeRetiredPacks();
+    }
+}
+
+void FontRenderCache::closeRetiredPacks() const
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    //! NOTE A new reader could have started, it does not use the retired packs,
+    //! but closing is left to it (they are closed by the last one)
+    if (m_readers.load(std::memory_order_acquire) > 0) {
+        return;
+    }
+
+    m_retiredPacks.clear();
+    m_hasRetiredPacks.store(false, std::memory_order_release);
+}
+
 const mu::io::path_t& FontRenderCache::resDirPath() const
 {
     static mu::io::path_t path = ":/SDFCache/";
@@ -70,150 +104,249 @@ const mu::io::path_t& FontRenderCache::resDirPath() const
 
 const mu::io::path_t& FontRenderCache::cacheDirPath() const
 {
-    static mu::io::path_t path = "/SDFCache/"; //xtz::io::CachePath() + "/SDFCache/";
-    return path;
+    return m_cacheDirPath;
 }
 
-static std::string realToString(double n)
+void FontRenderCache::setCacheDirPath(const mu::io::path_t& path)
 {
-    return std::to_string(int(n * 100));
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    m_cache.clear();
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_clockHand = 0;
+    m_bytes = 0;
+
+    //! NOTE The images returned before can be views into the packs,
+    //! so the packs are kept (with their mappings) while there are readers
+    m_cacheDirPath = path;
+    if (m_packsOpened) {
+        if (m_readers.load(std::memory_order_acquire) > 0) {
+            m_retiredPacks.push_back(std::move(m_pack));
+            m_retiredPacks.push_back(std::move(m_resPack));
+            m_hasRetiredPacks.store(true, std::memory_order_release);
+        }
+        m_pack = std::make_unique<SdfPackFile>();
+        m_resPack = std::make_unique<SdfPackFile>();
+    }
+    m_packsOpened = false;
 }
 
-static double realFromString(const std::string& str)
+void FontRenderCache::setResourceCacheEnabled(bool enabled)
 {
-    return std::stod(str) / 100.0;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_resourceCacheEnabled = enabled;
 }
 
-static std::string keyToString(const FaceKey& face, glyph_idx_t glyphIdx)
+mu::io::path_t FontRenderCache::packFilePath() const
 {
+    return cacheDirPath() + PACK_FILE_NAME;
+}
+
+//! NOTE The font is identified by the hash of its content, not by the name,
+//! the shapes depend on the face pixel size (the shape units are its pixels)
+static std::string keyToString(uint64_t fontHash, const FaceKey& face, glyph_idx_t glyphIdx, const SdfParams& params)
+{
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(fontHash));
+
     std::string str;
-    str.reserve(50);
-    str += face.dataKey.family();
+    str.reserve(64);
+    str += hash;
     str += "_" + std::to_string(glyphIdx);
-    str += "_" + std::to_string(face.dataKey.bold());
-    str += "_" + std::to_string(face.dataKey.italic());
     str += "_" + std::to_string(face.pixelSize);
+    str += "_" + std::to_string(static_cast<int>(params.format));
+    str += "_" + std::to_string(params.density);
+    str += "_" + std::to_string(params.range);
+    str += "_" + std::to_string(params.minSize);
+    str += "_" + std::to_string(params.maxSize);
+    str += "_v" + std::to_string(SDF_GENERATOR_VERSION);
     return str;
 }
 
-mu::io::path_t FontRenderCache::makeFilePath(const FaceKey& face, glyph_idx_t glyphIdx, const GlyphImage& image) const
+void FontRenderCache::openPacks() const
 {
-    std::string str;
-    str.reserve(100);
-    str += keyToString(face, glyphIdx);
-    str += "_[" + std::to_string(image.sdf.width) + "|" + std::to_string(image.sdf.height) + "|"
-           + realToString(image.rect.x()) + "|" + realToString(image.rect.y()) + "|"
-           + realToString(image.rect.width()) + "|" + realToString(image.rect.height());
-    str += "].sdf";
+    if (m_packsOpened) {
+        return;
+    }
+    m_packsOpened = true;
+
+    const mu::io::path_t resPackPath = resDirPath() + PACK_FILE_NAME;
+    if (m_resourceCacheEnabled && mu::io::File::exists(resPackPath)) {
+        //! NOTE The pack keeps the data, the found images are views into it
+        mu::io::File file(resPackPath);
+        if (file.open(mu::io::IODevice::ReadOnly)) {
+            m_resPack->openData(file.readAll());
+        }
+    }
 
-    return mu::io::path_t(str);
+    if (isStoreToFS()) {
+        m_pack->open(packFilePath());
+    }
+
+    LOGD() << "sdf packs opened, resource glyphs: " << m_resPack->count() << ", cached glyphs: " << m_pack->count();
 }
 
-void FontRenderCache::store(const FaceKey& face, glyph_idx_t glyphIdx, const GlyphImage& image)
+void FontRenderCache::clearMemoryCache()
 {
-    GlyphImages& images = m_cache[face];
-#ifdef DEBUG
-    if (images.find(glyphIdx) != images.end()) {
-        assert(images.find(glyphIdx) == images.end());
-    }
-#endif
-    images[glyphIdx] = image;
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    //! NOTE The packs are not closed, so the images returned before remain valid
+    m_cache.clear();
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_clockHand = 0;
+    m_bytes = 0;
+}
 
-    if (isStoreToFS()) {
-        mu::io::path_t fileFullPath = cacheDirPath() + makeFilePath(face, glyphIdx, image);
-        mu::io::File file(fileFullPath);
-        if (!file.open(mu::io::IODevice::WriteOnly)) {
-            LOGE() << "failed open to write file: " << fileFullPath;
-            return;
-        }
+void FontRenderCache::setMemoryBudget(size_t bytes)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_budget = bytes;
+    evict(0);
+}
 
-        file.write(image.sdf.bitmap);
-    }
+size_t FontRenderCache::memoryBudget() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_budget;
 }
 
-GlyphImage FontRenderCache::load(const FaceKey& face, glyph_idx_t glyphIdx) const
+FontRenderCache::Stats FontRenderCache::stats() const
 {
-    auto fit = m_cache.find(face);
-    if (fit != m_cache.end()) {
-        const GlyphImages& images = fit->second;
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    Stats s;
+    s.hits = m_hits.load(std::memory_order_relaxed);
+    s.packHits = m_packHits;
+    s.misses = m_misses;
+    s.evictions = m_evictions;
+    s.count = m_cache.size();
+    s.bytes = m_bytes;
+    return s;
+}
 
-        auto iit = images.find(glyphIdx);
-        if (iit != images.end()) {
-            return iit->second;
-        }
-    }
+void FontRenderCache::store(const FaceKey& face, uint64_t fontHash, glyph_idx_t glyphIdx, const SdfParams& params,
+                            const GlyphImage& image)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
 
-    if (m_cacheInfoMap.empty()) {
-        loadCachedInfo(m_cacheInfoMap, resDirPath());
-        if (isStoreToFS()) {
-            loadCachedInfo(m_cacheInfoMap, cacheDirPath());
-        }
-    }
+    const CacheKey key { face.packed(), glyphIdx };
 
-    CacheInfo info;
-    auto it = m_cacheInfoMap.find(keyToString(face, glyphIdx));
-    if (it != m_cacheInfoMap.end()) {
-        info = it->second;
+    //! NOTE Another thread could have generated and stored this glyph at the same time
+    if (m_cache.find(key) != m_cache.end()) {
+        return;
     }
 
-    if (!info.filePath.empty()) {
-        mu::io::File file(info.filePath);
-        if (!file.open(mu::io::IODevice::ReadOnly)) {
-            LOGE() << "failed read file: " << file.filePath();
-            return GlyphImage();
+    putInMemory(key, image);
+
+    if (isStoreToFS()) {
+        openPacks();
+        if (m_pack->isOpened()) {
+            m_pack->append(keyToString(fontHash, face, glyphIdx, params), image);
         }
+    }
+}
 
-        GlyphImage image;
-        image.sdf.bitmap = file.readAll();
-        image.sdf.width = info.width;
-        image.sdf.height = info.height;
-        image.rect = info.rect;
+bool FontRenderCache::findInMemory(const CacheKey& key, GlyphImage& image) const
+{
+    auto it = m_cache.find(key);
+    if (it == m_cache.end()) {
+        return false;
+    }
 
-        GlyphImages& images = m_cache[face];
-#ifdef DEBUG
-        if (images.find(glyphIdx) != images.end()) {
-            assert(images.find(glyphIdx) == images.end());
-        }
-#endif
-        images[glyphIdx] = image;
+    const Slot& slot = m_slots[it->second];
+    slot.referenced.store(true, std::memory_order_relaxed);
+    image = slot.image;
+    return true;
+}
 
-        return image;
+void FontRenderCache::putInMemory(const CacheKey& key, const GlyphImage& image) const
+{
+    const size_t bytes = image.sdf.bitmap.size();
+    evict(bytes);
+
+    size_t idx = 0;
+    if (!m_freeSlots.empty()) {
+        idx = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        idx = m_slots.size();
+        m_slots.emplace_back();
     }
 
-    return GlyphImage();
+    Slot& slot = m_slots[idx];
+    slot.key = key;
+    slot.image = image;
+    slot.bytes = bytes;
+    slot.used = true;
+    //! NOTE Not referenced, so an image that is not used again is evicted on the first pass
+    slot.referenced.store(false, std::memory_order_relaxed);
+
+    m_cache[key] = idx;
+    m_bytes += bytes;
 }
 
-void FontRenderCache::loadCachedInfo(CacheInfoMap& map, const mu::io::path_t& dir) const
+void FontRenderCache::evict(size_t bytes) const
 {
-    mu::RetVal<mu::io::paths_t> files = mu::io::Dir::scanFiles(dir, {}, mu::io::ScanMode::FilesInCurrentDir);
-    for (const mu::io::path_t& p : files.val) {
-        std::string str = mu::io::FileInfo(p).baseName().toStdString();
+    if (m_slots.empty()) {
+        return;
+    }
+
+    //! NOTE Two passes at most: the first one may only clear the referenced bits
+    size_t steps = m_slots.size() * 2;
+    while (m_bytes + bytes > m_budget && !m_cache.empty() && steps-- > 0) {
+        const size_t idx = m_clockHand;
+        Slot& slot = m_slots[idx];
+        m_clockHand = (m_clockHand + 1) % m_slots.size();
 
-        size_t startInfoIdx = str.find('[');
-        if (startInfoIdx == std::string::npos) {
+        if (!slot.used) {
             continue;
         }
 
-        size_t endInfoIdx = str.find(']');
-        if (endInfoIdx == std::string::npos) {
+        if (slot.referenced.exchange(false, std::memory_order_relaxed)) {
             continue;
         }
 
-        std::string key = str.substr(0, startInfoIdx - 1);
-        std::string data = str.substr(startInfoIdx + 1, endInfoIdx - startInfoIdx - 1);
-        std::vector<std::string> params;
-        mu::strings::split(data, params, "|");
-        if (params.size() != 6) {
-            continue;
+        m_cache.erase(slot.key);
+        m_bytes -= slot.bytes;
+        slot.image = GlyphImage();
+        slot.bytes = 0;
+        slot.used = false;
+        m_freeSlots.push_back(idx);
+        ++m_evictions;
+    }
+}
+
+GlyphImage FontRenderCache::load(const FaceKey& face, uint64_t fontHash, glyph_idx_t glyphIdx, const SdfParams& params) const
+{
+    const CacheKey cacheKey { face.packed(), glyphIdx };
+
+    GlyphImage image;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (findInMemory(cacheKey, image)) {
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return image;
         }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    // could be stored while the lock was released
+    if (findInMemory(cacheKey, image)) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return image;
+    }
 
-        CacheInfo info;
-        info.filePath = p;
-        info.width = std::stoi(params.at(0));
-        info.height = std::stoi(params.at(1));
-        info.rect = mu::RectF(realFromString(params.at(2)), realFromString(params.at(3)),
-                              realFromString(params.at(4)), realFromString(params.at(5)));
+    openPacks();
 
-        map[key] = info;
+    const std::string key = keyToString(fontHash, face, glyphIdx, params);
+    if (m_resPack->find(key, image) || (m_pack->isOpened() && m_pack->find(key, image))) {
+        ++m_packHits;
+        putInMemory(cacheKey, image);
+        return image;
     }
+
+    ++m_misses;
+    return GlyphImage();
 }
@@ -1,11 +1,17 @@
 #ifndef XTZ_FONTS_FONTRENDERCACHE_H
 #define XTZ_FONTS_FONTRENDERCACHE_H
 
-#include <map>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <shared_mutex>
 
 #include "global/io/path.h"
 
 #include "fonts/fontstypes.hpp"
+#include "sdfpackfile.hpp"
 
 namespace xtz::fonts {
 class FontRenderCache
@@ -15,33 +21,116 @@ public:
 
     void init();
 
-    void store(const FaceKey& face, glyph_idx_t glyphIdx, const GlyphImage& image);
-    GlyphImage load(const FaceKey& face, glyph_idx_t glyphIdx) const;
+    //! NOTE The images loaded from the packs are views into their mappings.
+    //! A user of the loaded images holds a Reader while it uses them,
+    //! the packs replaced by setCacheDirPath are closed when there are no readers
+    class Reader
+    {
+    public:
+        explicit Reader(const FontRenderCache& cache);
+        ~Reader();
 
-private:
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
 
-    bool isStoreToFS() const;
+    private:
+        const FontRenderCache& m_cache;
+    };
 
-    const mu::io::path_t& resDirPath() const;
-    const mu::io::path_t& cacheDirPath() const;
-    mu::io::path_t makeFilePath(const FaceKey& face, glyph_idx_t glyphIdx, const GlyphImage& image) const;
+    // For dev
+    void setCacheDirPath(const mu::io::path_t& path);
+    void setResourceCacheEnabled(bool enabled);
+    mu::io::path_t packFilePath() const;
+
+    //! NOTE The entries of the packs are keyed by the font content hash (see IFontFace::contentHash)
+    //! and the params, so a changed font or params do not find the images of the previous ones.
+    //! The memory cache is for the current fonts and params (see clearMemoryCache)
+    void store(const FaceKey& face, uint64_t fontHash, glyph_idx_t glyphIdx, const SdfParams& params, const GlyphImage& image);
+    GlyphImage load(const FaceKey& face, uint64_t fontHash, glyph_idx_t glyphIdx, const SdfParams& params) const;
+
+    void clearMemoryCache();
+
+    //! NOTE The memory cache is bounded by the bytes of the bitmaps,
+    //! the evicted images are fetched from the packs again
+    void setMemoryBudget(size_t bytes);
+    size_t memoryBudget() const;
+
+    struct Stats {
+        uint64_t hits = 0;          // found in memory
+        uint64_t packHits = 0;      // fetched from the packs
+        uint64_t misses = 0;        // not found, to be generated
+        uint64_t evictions = 0;
+        size_t count = 0;           // images in memory
+        size_t bytes = 0;
+    };
+    Stats stats() const;
+
+private:
 
-    using GlyphImages = std::unordered_map<glyph_idx_t, GlyphImage>;
+    struct CacheKey {
+        uint64_t face = 0;      // FaceKey::packed
+        glyph_idx_t glyph = 0;
 
-    mutable std::map<FaceKey, GlyphImages> m_cache;
+        inline bool operator==(const CacheKey& o) const { return face == o.face && glyph == o.glyph; }
+    };
 
-    struct CacheInfo {
-        mu::io::path_t filePath;
-        uint32_t width = 0;
-        uint32_t height = 0;
-        mu::RectF rect;
+    struct CacheKeyHash {
+        size_t operator()(const CacheKey& k) const { return static_cast<size_t>(hashMix(k.face ^ (uint64_t(k.glyph) << 40))); }
     };
 
-    using CacheInfoMap = std::map<std::string /*key*/, CacheInfo>;
+    //! NOTE CLOCK: a hit sets the referenced bit (under the shared lock),
+    //! the hand clears it, the not referenced slot is evicted
+    struct Slot {
+        CacheKey key;
+        GlyphImage image;
+        size_t bytes = 0;
+        bool used = false;
+        mutable std::atomic<bool> referenced { false };
+    };
 
-    void loadCachedInfo(CacheInfoMap& map, const mu::io::path_t& dir) const;
+    bool isStoreToFS() const;
+
+    const mu::io::path_t& resDirPath() const;
+    const mu::io::path_t& cacheDirPath() const;
 
-    mutable CacheInfoMap m_cacheInfoMap;
+    void openPacks() const;
+    void closeRetiredPacks() const;
+    bool findInMemory(const CacheKey& key, GlyphImage& image) const;
+    // expect the unique lock
+    void putInMemory(const CacheKey& key, const GlyphImage& image) const;
+    void evict(size_t bytes) const;
+
+    //! NOTE Guards the memory cache and the packs.
+    //! Hits in the memory cache take a shared lock, so readers are not blocked
+    //! by each other, only while an image is published or looked up in the packs
+    mutable std::shared_mutex m_mutex;
+
+    mu::io::path_t m_cacheDirPath = "/SDFCache/"; //xtz::io::CachePath() + "/SDFCache/";
+    bool m_resourceCacheEnabled = true;
+
+    //! NOTE The images of the memory cache can be views into the packs,
+    //! so the packs are declared before (and destroyed after) the memory cache.
+    //! The packs replaced by setCacheDirPath are retired, not closed,
+    //! so the images returned before remain valid until the last reader is done
+    mutable bool m_packsOpened = false;
+    mutable std::unique_ptr<SdfPackFile> m_resPack = std::make_unique<SdfPackFile>();
+    mutable std::unique_ptr<SdfPackFile> m_pack = std::make_unique<SdfPackFile>();
+    mutable std::vector<std::unique_ptr<SdfPackFile> > m_retiredPacks;
+    mutable std::atomic<size_t> m_readers { 0 };
+    mutable std::atomic<bool> m_hasRetiredPacks { false };
+
+    //! NOTE deque, so the slots (with atomics) are not moved
+    mutable std::deque<Slot> m_slots;
+    mutable std::vector<size_t> m_freeSlots;
+    mutable std::unordered_map<CacheKey, size_t, CacheKeyHash> m_cache;
+    mutable size_t m_clockHand = 0;
+    mutable size_t m_bytes = 0;
+    size_t m_budget = 64 * 1024 * 1024;
+
+    mutable std::atomic<uint64_t> m_hits { 0 };
+    mutable uint64_t m_packHits = 0;
+    mutable uint64_t m_misses = 0;
+    mutable uint64_t m_evictions = 0;
 };
 }
 
@@ -35,7 +35,7 @@ const FontDataKey& FontsDatabase::defaultFont(mu::draw::Font::Type type) const
 int FontsDatabase::addFont(const FontDataKey& key, const mu::io::path_t& path)
 {
     s_fontID++;
-    m_fonts.push_back(FontInfo { s_fontID, key, path });
+    m_fonts.emplace(key, FontInfo { s_fontID, key, path });
     return s_fontID;
 }
 
@@ -81,10 +81,9 @@ mu::io::path_t FontsDatabase::fontPath(const FontDataKey& requireKey, mu::draw::
 
 const FontsDatabase::FontInfo& FontsDatabase::fontInfo(const FontDataKey& key) const
 {
-    for (const FontInfo& fi : m_fonts) {
-        if (fi.key == key) {
-            return fi;
-        }
+    auto it = m_fonts.find(key);
+    if (it != m_fonts.end()) {
+        return it->second;
     }
 
     static FontInfo null;
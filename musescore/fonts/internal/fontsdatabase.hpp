@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 // xtz
 #include "../ifontsdatabase.hpp"
@@ -37,7 +38,8 @@ private:
     const FontInfo& fontInfo(const FontDataKey& key) const;
 
     std::map<mu::draw::Font::Type, FontDataKey> m_defaults;
-    std::vector<FontInfo> m_fonts;
+    //! NOTE If a font is added several times, the first one is used
+    std::unordered_map<FontDataKey, FontInfo> m_fonts;
 };
 }
 #endif // XTZ_FONTS_FONTSDATABASE_H
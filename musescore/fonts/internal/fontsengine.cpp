@@ -1,5 +1,10 @@
 #include "fontsengine.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+
 #include <msdfgen.h>
 #include <ext/import-font.h>
 
@@ -11,6 +16,9 @@
 #include "fontfaceft.hpp"
 #include "fontfacext.hpp"
 #include "fontfacedu.hpp"
+#include "codepointcoverage.hpp"
+#include "threadpool.hpp"
+#include "sdfkernel.hpp"
 
 #include "log.h"
 
@@ -22,8 +30,13 @@ static const double LOADED_PIXEL_SIZE = 200.0;
 
 static const double TEXT_LINE_SCALE = 1.2;
 
-static const int SDF_WIDTH = 64;
-static const int SDF_HEIGHT = 64;
+
+//! NOTE Glyphs of a prewarm task, so that a task is not too small for the pool
+static const size_t PREWARM_CHUNK_SIZE = 16;
+
+//! NOTE The atlas is repacked when the glyphs removed by setSdfParams leave this part of it unused
+static const double ATLAS_DEFRAGMENT_WASTE_RATIO = 0.5;
+static const int ATLAS_RENDER_ATTEMPTS = 3;
 
 static inline mu::RectF fromFBBox(const FBBox& bb, double scale)
 {
@@ -36,6 +49,27 @@ static inline mu::RectF scaleRect(const mu::RectF& r, double scale)
     return mu::RectF(r.x() * scale, r.y() * scale, r.width() * scale, r.height() * scale);
 }
 
+//! NOTE Calls func for each line of the text, the line includes its line break
+template<typename Func>
+static void forEachTextLine(std::u32string_view text, Func func)
+{
+    size_t lineStart = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (i == (text.size() - 1) || text[i] == U'\n') {
+            func(text.data() + lineStart, static_cast<int>(i - lineStart + 1));
+            lineStart = i + 1;
+        }
+    }
+}
+
+//! NOTE Per thread glyphs, the buffer is reused (the cached runs are shared),
+//! so measuring does not allocate memory once the buffer has grown
+static Glyphs& glyphsBuffer()
+{
+    thread_local Glyphs buffer;
+    return buffer;
+}
+
 bool FontsEngine::RequireFace::isSymbolMode() const
 {
     return face ? face->isSymbolMode() : false;
@@ -52,12 +86,16 @@ double FontsEngine::RequireFace::pixelScale() const
 
 FontsEngine::~FontsEngine()
 {
-    for (RequireFace* f : m_requiredFaces) {
-        delete f;
+    //! NOTE Finish the prewarm before the faces are deleted
+    //! (no prewarm can be running at destruction, so this is the last reference)
+    m_pool.reset();
+
+    for (auto& p : m_requiredFaces) {
+        delete p.second;
     }
 
-    for (IFontFace* f : m_loadedFaces) {
-        delete f;
+    for (auto& p : m_loadedFaces) {
+        delete p.second;
     }
 }
 
@@ -68,7 +106,12 @@ void FontsEngine::init()
 
 double FontsEngine::lineSpacing(const mu::draw::Font& f) const
 {
-    RequireFace* rf = fontFace(f);
+    return lineSpacing(resolve(f));
+}
+
+double FontsEngine::lineSpacing(const FontHandle& h) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
@@ -78,7 +121,12 @@ double FontsEngine::lineSpacing(const mu::draw::Font& f) const
 
 double FontsEngine::xHeight(const mu::draw::Font& f) const
 {
-    RequireFace* rf = fontFace(f);
+    return xHeight(resolve(f));
+}
+
+double FontsEngine::xHeight(const FontHandle& h) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
@@ -88,7 +136,12 @@ double FontsEngine::xHeight(const mu::draw::Font& f) const
 
 double FontsEngine::height(const mu::draw::Font& f) const
 {
-    RequireFace* rf = fontFace(f);
+    return height(resolve(f));
+}
+
+double FontsEngine::height(const FontHandle& h) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
@@ -98,7 +151,12 @@ double FontsEngine::height(const mu::draw::Font& f) const
 
 double FontsEngine::ascent(const mu::draw::Font& f) const
 {
-    RequireFace* rf = fontFace(f);
+    return ascent(resolve(f));
+}
+
+double FontsEngine::ascent(const FontHandle& h) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
@@ -108,7 +166,12 @@ double FontsEngine::ascent(const mu::draw::Font& f) const
 
 double FontsEngine::descent(const mu::draw::Font& f) const
 {
-    RequireFace* rf = fontFace(f);
+    return descent(resolve(f));
+}
+
+double FontsEngine::descent(const FontHandle& h) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
@@ -118,7 +181,12 @@ double FontsEngine::descent(const mu::draw::Font& f) const
 
 bool FontsEngine::inFontUcs4(const mu::draw::Font& f, char32_t ucs4) const
 {
-    RequireFace* rf = fontFace(f);
+    return inFontUcs4(resolve(f), ucs4);
+}
+
+bool FontsEngine::inFontUcs4(const FontHandle& h, char32_t ucs4) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return false;
     }
@@ -128,7 +196,12 @@ bool FontsEngine::inFontUcs4(const mu::draw::Font& f, char32_t ucs4) const
 
 double FontsEngine::horizontalAdvance(const mu::draw::Font& f, const char32_t& ch) const
 {
-    RequireFace* rf = fontFace(f);
+    return horizontalAdvance(resolve(f), ch);
+}
+
+double FontsEngine::horizontalAdvance(const FontHandle& h, const char32_t& ch) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
@@ -137,18 +210,24 @@ double FontsEngine::horizontalAdvance(const mu::draw::Font& f, const char32_t& c
     return from_f26d6(rf->face->glyphAdvance(glyphIdx)) * rf->pixelScale();
 }
 
-double FontsEngine::horizontalAdvance(const mu::draw::Font& f, const std::u32string& text) const
+double FontsEngine::horizontalAdvance(const mu::draw::Font& f, std::u32string_view text) const
+{
+    return horizontalAdvance(resolve(f), text);
+}
+
+double FontsEngine::horizontalAdvance(const FontHandle& h, std::u32string_view text) const
 {
     if (text.empty()) {
         return 0.0;
     }
 
-    RequireFace* rf = fontFace(f);
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
 
-    std::vector<GlyphPos> glyphs = rf->face->glyphs(&text[0], (int)text.size());
+    Glyphs& glyphs = glyphsBuffer();
+    rf->face->glyphs(text.data(), (int)text.size(), glyphs);
     f26dot6_t advance = 0;
     for (const GlyphPos& g : glyphs) {
         advance += g.x_advance;
@@ -159,7 +238,12 @@ double FontsEngine::horizontalAdvance(const mu::draw::Font& f, const std::u32str
 
 mu::RectF FontsEngine::boundingRect(const mu::draw::Font& f, const char32_t& ch) const
 {
-    RequireFace* rf = fontFace(f);
+    return boundingRect(resolve(f), ch);
+}
+
+mu::RectF FontsEngine::boundingRect(const FontHandle& h, const char32_t& ch) const
+{
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return mu::RectF();
     }
@@ -168,13 +252,18 @@ mu::RectF FontsEngine::boundingRect(const mu::draw::Font& f, const char32_t& ch)
     return fromFBBox(rf->face->glyphBbox(glyphIdx), rf->pixelScale());
 }
 
-mu::RectF FontsEngine::boundingRect(const mu::draw::Font& f, const std::u32string& text) const
+mu::RectF FontsEngine::boundingRect(const mu::draw::Font& f, std::u32string_view text) const
+{
+    return boundingRect(resolve(f), text);
+}
+
+mu::RectF FontsEngine::boundingRect(const FontHandle& h, std::u32string_view text) const
 {
     if (text.empty()) {
         return mu::RectF();
     }
 
-    RequireFace* rf = fontFace(f);
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return mu::RectF();
     }
@@ -184,12 +273,12 @@ mu::RectF FontsEngine::boundingRect(const mu::draw::Font& f, const std::u32strin
     bool isFirstLine = true;
     bool isFirstInLine = true;
 
-    std::vector<TextLine> lines = splitTextByLines(text);
-    for (const TextLine& l : lines) {
+    Glyphs& glyphs = glyphsBuffer();
+    forEachTextLine(text, [&](const char32_t* lineText, int lineLength) {
         lineRect = FBBox();
         isFirstInLine = true;
 
-        std::vector<GlyphPos> glyphs = rf->face->glyphs(l.text, l.lenght);
+        rf->face->glyphs(lineText, lineLength, glyphs);
         for (const GlyphPos& g : glyphs) {
             FBBox bbox = rf->face->glyphBbox(g.idx);
             if (isFirstInLine) {
@@ -210,18 +299,23 @@ mu::RectF FontsEngine::boundingRect(const mu::draw::Font& f, const std::u32strin
             rect.setWidth(std::max(rect.width(), lineRect.width()));
             rect.setHeight(rect.height() + lineRect.height());
         }
-    }
+    });
 
     return fromFBBox(rect, rf->pixelScale());
 }
 
-mu::RectF FontsEngine::tightBoundingRect(const mu::draw::Font& f, const std::u32string& text) const
+mu::RectF FontsEngine::tightBoundingRect(const mu::draw::Font& f, std::u32string_view text) const
+{
+    return tightBoundingRect(resolve(f), text);
+}
+
+mu::RectF FontsEngine::tightBoundingRect(const FontHandle& h, std::u32string_view text) const
 {
     if (text.empty()) {
         return mu::RectF();
     }
 
-    RequireFace* rf = fontFace(f);
+    const RequireFace* rf = textFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return mu::RectF();
     }
@@ -231,12 +325,12 @@ mu::RectF FontsEngine::tightBoundingRect(const mu::draw::Font& f, const std::u32
     bool isFirstLine = true;
     bool isFirstInLine = true;
 
-    std::vector<TextLine> lines = splitTextByLines(text);
-    for (const TextLine& l : lines) {
+    Glyphs& glyphs = glyphsBuffer();
+    forEachTextLine(text, [&](const char32_t* lineText, int lineLength) {
         lineRect = FBBox();
         isFirstInLine = true;
 
-        std::vector<GlyphPos> glyphs = rf->face->glyphs(l.text, l.lenght);
+        rf->face->glyphs(lineText, lineLength, glyphs);
         for (const GlyphPos& g : glyphs) {
             FBBox bbox = rf->face->glyphBbox(g.idx);
 
@@ -256,8 +350,10 @@ mu::RectF FontsEngine::tightBoundingRect(const mu::draw::Font& f, const std::u32
             advance += g.x_advance;
         }
 
-        GlyphPos lastGlyph = glyphs.back();
-        advance -= (lastGlyph.x_advance - rf->face->glyphBbox(lastGlyph.idx).width());
+        if (!glyphs.empty()) {
+            const GlyphPos& lastGlyph = glyphs.back();
+            advance -= (lastGlyph.x_advance - rf->face->glyphBbox(lastGlyph.idx).width());
+        }
         lineRect.setWidth(advance);
 
         if (isFirstLine) {
@@ -267,14 +363,19 @@ mu::RectF FontsEngine::tightBoundingRect(const mu::draw::Font& f, const std::u32
             rect.setWidth(std::max(rect.width(), lineRect.width()));
             rect.setHeight(rect.height() + lineRect.height());
         }
-    }
+    });
 
     return fromFBBox(rect, rf->pixelScale());
 }
 
 mu::RectF FontsEngine::symBBox(const mu::draw::Font& f, char32_t ucs4) const
 {
-    RequireFace* rf = fontFace(f, true);
+    return symBBox(resolve(f), ucs4);
+}
+
+mu::RectF FontsEngine::symBBox(const FontHandle& h, char32_t ucs4) const
+{
+    const RequireFace* rf = symbolFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return mu::RectF();
     }
@@ -286,7 +387,12 @@ mu::RectF FontsEngine::symBBox(const mu::draw::Font& f, char32_t ucs4) const
 
 double FontsEngine::symAdvance(const mu::draw::Font& f, char32_t ucs4) const
 {
-    RequireFace* rf = fontFace(f, true);
+    return symAdvance(resolve(f), ucs4);
+}
+
+double FontsEngine::symAdvance(const FontHandle& h, char32_t ucs4) const
+{
+    const RequireFace* rf = symbolFace(h);
     IF_ASSERT_FAILED(rf && rf->face) {
         return 0.0;
     }
@@ -296,7 +402,50 @@ double FontsEngine::symAdvance(const mu::draw::Font& f, char32_t ucs4) const
     return from_f26d6(advance) * rf->pixelScale();
 }
 
-static void generateSdf(GlyphImage& out, glyph_idx_t glyphIdx, IFontFace* face)
+std::vector<SymMetrics> FontsEngine::symMetrics(const mu::draw::Font& f, const std::vector<char32_t>& codes) const
+{
+    return symMetrics(resolve(f), codes);
+}
+
+std::vector<SymMetrics> FontsEngine::symMetrics(const FontHandle& h, const std::vector<char32_t>& codes) const
+{
+    const RequireFace* rf = symbolFace(h);
+    IF_ASSERT_FAILED(rf && rf->face) {
+        return std::vector<SymMetrics>(codes.size());
+    }
+
+    const double scale = rf->pixelScale();
+
+    std::vector<SymMetrics> result;
+    result.reserve(codes.size());
+    for (char32_t ucs4 : codes) {
+        SymMetrics m;
+        m.code = ucs4;
+        glyph_idx_t glyphIdx = rf->face->glyphIndex(ucs4);
+        m.inFont = glyphIdx != 0;
+        if (m.inFont) {
+            m.bbox = fromFBBox(rf->face->glyphBbox(glyphIdx), scale);
+            m.advance = from_f26d6(rf->face->glyphAdvance(glyphIdx)) * scale;
+        }
+        result.push_back(std::move(m));
+    }
+
+    return result;
+}
+
+//! NOTE Placement of the glyph shape into the SDF bitmap
+struct SdfLayout {
+    double boundsL = 0.0;
+    double range = 0.0;
+    double scale = 0.0;
+    msdfgen::Vector2 translate;
+    int width = 0;
+    int height = 0;
+    mu::RectF rect;
+};
+
+//! NOTE The shape units are the pixels of the face, so an em is the face pixel size
+static bool sdfLayout(const msdfgen::Shape& shape, const SdfParams& params, double emSize, SdfLayout& out)
 {
     struct Bounds
     {
@@ -304,106 +453,377 @@ static void generateSdf(GlyphImage& out, glyph_idx_t glyphIdx, IFontFace* face)
     };
     Bounds bounds = { 1e240, 1e240, -1e240, -1e240 };
 
-    msdfgen::Shape shape = face->glyphShape(glyphIdx);
+    shape.bounds(bounds.l, bounds.b, bounds.r, bounds.t);
+
+    IF_ASSERT_FAILED(bounds.l < bounds.r && bounds.b < bounds.t && emSize > 0.0) {
+        return false;
+    }
+
+    const double pxRange = params.range;
+    const double boundsWidth = bounds.r - bounds.l;
+    const double boundsHeight = bounds.t - bounds.b;
+
+    //! NOTE The density is lowered for a glyph that does not fit the max size
+    double scale = params.density / emSize;
+    const double maxFrame = params.maxSize - 2 * pxRange;
+    if (std::max(boundsWidth, boundsHeight) * scale > maxFrame) {
+        scale = maxFrame / std::max(boundsWidth, boundsHeight);
+    }
+
+    //! NOTE The glyph is at the left bottom, the rest up to the min size is whitespace
+    const int minSize = static_cast<int>(params.minSize);
+    out.width = std::max(minSize, static_cast<int>(std::ceil(boundsWidth * scale)) + 2 * static_cast<int>(params.range));
+    out.height = std::max(minSize, static_cast<int>(std::ceil(boundsHeight * scale)) + 2 * static_cast<int>(params.range));
+
+    const double range = pxRange / scale;
+
+    out.boundsL = bounds.l;
+    out.range = range;
+    out.scale = scale;
+    out.translate = msdfgen::Vector2(-bounds.l + range, -bounds.b + range);
+
+    const double width = out.width / scale;
+    const double height = out.height / scale;
+    out.rect.setTop(-bounds.b + range - height);
+    out.rect.setLeft(bounds.l - range);
+    out.rect.setWidth(width);
+    out.rect.setHeight(height);
+
+    return true;
+}
+
+static void generateSdf(GlyphImage& out, glyph_idx_t glyphIdx, IFontFace* face, const SdfParams& sdfParams)
+{
+    //! NOTE The shape is not copied, the kernel takes all its contours
+    const msdfgen::Shape& shape = face->glyphShape(glyphIdx);
     if (shape.contours.empty()) {
         //! NOTE Maybe not printable, like ' '
         return;
     }
 
-    shape.bounds(bounds.l, bounds.b, bounds.r, bounds.t);
+    SdfLayout layout;
+    if (!sdfLayout(shape, sdfParams, face->key().pixelSize, layout)) {
+        return;
+    }
 
-    uint32_t pxRange = std::min(SDF_WIDTH, SDF_HEIGHT) >> 3;
+    SdfKernel::Params params;
+    params.range = layout.range;
+    params.scale = layout.scale;
+    params.translateX = layout.translate.x;
+    params.translateY = layout.translate.y;
+    params.multiChannel = sdfParams.format == SdfFormat::Msdf;
+
+    //! NOTE Per thread, so that the memory of the segments is reused
+    thread_local SdfKernel kernel;
+    kernel.prepare(shape, params);
+
+    const uint8_t channels = sdfChannels(sdfParams.format);
+    mu::ByteArray bitmap;
+    bitmap.resize(size_t(layout.width) * layout.height * channels);
+    kernel.generate(bitmap.data(), layout.width, layout.height);
+
+    out.sdf.bitmap = bitmap;
+    out.sdf.width = layout.width;
+    out.sdf.height = layout.height;
+    out.sdf.format = sdfParams.format;
+    out.sdf.channels = channels;
+    out.rect = layout.rect;
+}
 
-    std::pair<double, double> sdfScale;
-    msdfgen::Vector2 translate;
-    double scale = 0.0;
-    msdfgen::Vector2 frame(SDF_WIDTH, SDF_HEIGHT);
-    frame -= 2 * pxRange;
-    assert(frame.x >= 0 && frame.y >= 0 && bounds.l < bounds.r && bounds.b < bounds.t);
-    msdfgen::Vector2 dims(bounds.r - bounds.l, bounds.t - bounds.b);
-    if (dims.x * frame.y < dims.y * frame.x) { // fit restricted by height
-        translate = { -bounds.l, -bounds.b };
-        scale = frame.y / dims.y;
-        sdfScale = { (frame.x - dims.x * scale) / (dims.x * scale), 0.0f };
-    } else { // fit restricted by width
-        translate = { -bounds.l, -bounds.b };
-        scale = frame.x / dims.x;
-        sdfScale = { 0.0, (frame.y - dims.y * scale) / (dims.y * scale) };
-    }
-
-    double boundsWidth = bounds.r - bounds.l;
-    double boundsHeight = bounds.t - bounds.b;
-    double widthWhitespace = boundsWidth * sdfScale.first;
-    double heightWhitespace = boundsHeight * sdfScale.second;
-    double pxRangeScaled = pxRange / scale;
-
-    double left = bounds.l - pxRangeScaled;
-    double top = -bounds.t - heightWhitespace - pxRangeScaled;
-    double width = boundsWidth + widthWhitespace + pxRangeScaled * 2;
-    double height = boundsHeight + heightWhitespace + pxRangeScaled * 2;
-
-    double range = pxRange / scale;
-    translate += range;
+//! NOTE The previous generator, to compare with, only single channel
+static void generateSdfReference(GlyphImage& out, glyph_idx_t glyphIdx, IFontFace* face, const SdfParams& sdfParams)
+{
+    msdfgen::Shape shape = face->glyphShape(glyphIdx);
+    if (shape.contours.empty()) {
+        return;
+    }
+
+    SdfLayout layout;
+    if (!sdfLayout(shape, sdfParams, face->key().pixelSize, layout)) {
+        return;
+    }
 
     shape.mergeContours();
 
-    auto sdf = msdfgen::Bitmap<uint8_t>(SDF_WIDTH, SDF_HEIGHT);
-    msdfgen::generateSDF(sdf, shape, bounds.l, range, scale, translate);
+    msdfgen::Bitmap<uint8_t> sdf(layout.width, layout.height);
+    msdfgen::generateSDF(sdf, shape, layout.boundsL, layout.range, layout.scale, layout.translate);
 
-    out.sdf.bitmap = mu::ByteArray(sdf.takeMemoryAway(), SDF_WIDTH * SDF_HEIGHT);
-    out.sdf.width = SDF_WIDTH;
-    out.sdf.height = SDF_HEIGHT;
+    //! NOTE Copied, the bitmap frees its memory
+    out.sdf.bitmap = mu::ByteArray(sdf.contentMemory(), size_t(layout.width) * layout.height);
+    out.sdf.width = layout.width;
+    out.sdf.height = layout.height;
+    out.rect = layout.rect;
+}
 
-    out.rect.setTop(top);
-    out.rect.setLeft(left);
-    out.rect.setWidth(width);
-    out.rect.setHeight(height);
+//! NOTE Glyphs without image
+static inline bool isNotRenderGlyph(glyph_idx_t glyphIdx)
+{
+    return glyphIdx == 3; // space
 }
 
-std::vector<GlyphImage> FontsEngine::render(const mu::draw::Font& f, const std::u32string& text) const
+//! NOTE Unique glyphs of the codes to render, empty codes - all glyphs
+static std::vector<glyph_idx_t> renderGlyphs(const IFontFace* face, const std::vector<char32_t>& codes)
+{
+    std::vector<glyph_idx_t> glyphs;
+    auto addGlyph = [&glyphs](glyph_idx_t glyphIdx) {
+        if (glyphIdx != 0 && !isNotRenderGlyph(glyphIdx)) {
+            glyphs.push_back(glyphIdx);
+        }
+    };
+
+    if (codes.empty()) {
+        //! NOTE Only the codepoints mapped by the face, not the whole Unicode range
+        const CodepointCoverage& coverage = face->coverage();
+        glyphs.reserve(coverage.size());
+        coverage.forEach([&addGlyph](char32_t c, glyph_idx_t glyphIdx) {
+            if (c >= 0x21) {
+                addGlyph(glyphIdx);
+            }
+        });
+    } else {
+        for (char32_t c : codes) {
+            addGlyph(face->glyphIndex(c));
+        }
+    }
+
+    // several codes can be mapped to one glyph
+    std::sort(glyphs.begin(), glyphs.end());
+    glyphs.erase(std::unique(glyphs.begin(), glyphs.end()), glyphs.end());
+
+    return glyphs;
+}
+
+GlyphImage FontsEngine::glyphImage(const RequireFace* rf, glyph_idx_t glyphIdx) const
+{
+    const SdfParams params = sdfParams(rf->face->key().type);
+    const uint64_t fontHash = rf->face->contentHash();
+    GlyphImage image = m_renderCache.load(rf->face->key(), fontHash, glyphIdx, params);
+    if (image.isNull()) {
+        generateSdf(image, glyphIdx, rf->face, params);
+        m_renderCache.store(rf->face->key(), fontHash, glyphIdx, params, image);
+    }
+    return image;
+}
+
+void FontsEngine::setSdfParams(mu::draw::Font::Type type, const SdfParams& params)
+{
+    IF_ASSERT_FAILED(params.density > 0 && params.range > 0
+                     && params.minSize >= 2 * params.range && params.maxSize > std::max(params.minSize, 2 * params.range)) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(m_sdfParamsMutex);
+        m_sdfParams[type] = params;
+    }
+
+    //! NOTE The images of the other params are not used anymore (they stay in the packs),
+    //! their place in the atlas is reused after defragmentation
+    m_renderCache.clearMemoryCache();
+    m_atlas.remove(type);
+    defragmentAtlas(ATLAS_DEFRAGMENT_WASTE_RATIO);
+}
+
+SdfParams FontsEngine::sdfParams(mu::draw::Font::Type type) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_sdfParamsMutex);
+    auto it = m_sdfParams.find(type);
+    if (it != m_sdfParams.end()) {
+        return it->second;
+    }
+    return SdfParams();
+}
+
+std::vector<AtlasGlyph> FontsEngine::render(const mu::draw::Font& f, std::u32string_view text) const
 {
     //! NOTE for rendering, all fonts, including symbols fonts, are processed as text
     RequireFace* rf = fontFace(f);
     IF_ASSERT_FAILED(rf && rf->face) {
-        return std::vector<GlyphImage>();
+        return std::vector<AtlasGlyph>();
     }
 
-    static const std::set<glyph_idx_t> NOT_RENDER_GLYPHS = {
-        3 // space
-    };
+    std::vector<AtlasGlyph> result;
+    result.reserve(text.size());
 
-    std::vector<GlyphImage> images;
+    //! NOTE The loaded images are views into the packs, until they are copied into the atlas
+    FontRenderCache::Reader reader(m_renderCache);
 
+    const FaceKey& faceKey = rf->face->key();
     int pixelSize = rf->requireKey.pixelSize;
     double pixelScale = rf->pixelScale();
-    double glyphTop = 0;
-    std::vector<TextLine> lines = splitTextByLines(text);
+    Glyphs& glyphs = glyphsBuffer();
 
-    for (const TextLine& l : lines) {
-        std::vector<GlyphPos> glyphs = rf->face->glyphs(l.text, l.lenght);
+    //! NOTE An insert over the atlas budget defragments it, then the glyphs rendered before
+    //! (of the previous generation) are rendered again. A few attempts, the text can be larger than the budget
+    for (int attempt = 0; attempt < ATLAS_RENDER_ATTEMPTS; ++attempt) {
+        result.clear();
 
-        double glyphLeft = 0;
-        for (const GlyphPos& g : glyphs) {
-            if (NOT_RENDER_GLYPHS.find(g.idx) == NOT_RENDER_GLYPHS.end()) {
-                GlyphImage image = m_renderCache.load(rf->face->key(), g.idx);
-                if (image.isNull()) {
-                    generateSdf(image, g.idx, rf->face);
-                    m_renderCache.store(rf->face->key(), g.idx, image);
+        double glyphTop = 0;
+        forEachTextLine(text, [&](const char32_t* lineText, int lineLength) {
+            rf->face->glyphs(lineText, lineLength, glyphs);
+
+            double glyphLeft = 0;
+            for (const GlyphPos& g : glyphs) {
+                if (!isNotRenderGlyph(g.idx)) {
+                    AtlasGlyph glyph;
+                    if (!m_atlas.find(faceKey, g.idx, glyph)) {
+                        glyph = m_atlas.insert(faceKey, g.idx, glyphImage(rf, g.idx));
+                    }
+
+                    glyph.rect = scaleRect(glyph.rect, pixelScale);
+                    glyph.rect.translate(glyphLeft, glyphTop);
+
+                    result.push_back(glyph);
                 }
 
-                image.rect = scaleRect(image.rect, pixelScale);
-                image.rect.translate(glyphLeft, glyphTop);
+                glyphLeft += from_f26d6(g.x_advance) * pixelScale;
+            }
+
+            glyphTop += (pixelSize * TEXT_LINE_SCALE);
+        });
+
+        if (result.empty() || result.front().generation == result.back().generation) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+uint32_t FontsEngine::atlasGeneration() const
+{
+    return m_atlas.generation();
+}
+
+size_t FontsEngine::atlasPagesCount() const
+{
+    return m_atlas.pagesCount();
+}
+
+bool FontsEngine::readAtlasPage(uint32_t page, const std::function<void(const AtlasPage&)>& func) const
+{
+    return m_atlas.readPage(page, func);
+}
+
+bool FontsEngine::defragmentAtlas(double minWasteRatio)
+{
+    if (m_atlas.wasteRatio() < minWasteRatio) {
+        return false;
+    }
+
+    m_atlas.defragment();
+    return true;
+}
 
-                images.push_back(std::move(image));
+std::shared_future<size_t> FontsEngine::prewarm(const mu::draw::Font& f, const std::vector<char32_t>& codes) const
+{
+    struct Job {
+        std::vector<glyph_idx_t> glyphs;
+        std::atomic<size_t> chunksLeft { 0 };
+        std::promise<size_t> promise;
+    };
+
+    auto job = std::make_shared<Job>();
+    std::shared_future<size_t> future = job->promise.get_future().share();
+
+    //! NOTE for rendering, all fonts, including symbols fonts, are processed as text
+    const RequireFace* rf = fontFace(f);
+    IF_ASSERT_FAILED(rf && rf->face) {
+        job->promise.set_value(0);
+        return future;
+    }
+
+    job->glyphs = renderGlyphs(rf->face, codes);
+
+    if (job->glyphs.empty()) {
+        job->promise.set_value(0);
+        return future;
+    }
+
+    const size_t count = job->glyphs.size();
+    const size_t chunks = (count + PREWARM_CHUNK_SIZE - 1) / PREWARM_CHUNK_SIZE;
+    job->chunksLeft = chunks;
+
+    std::vector<ThreadPool::Task> tasks;
+    tasks.reserve(chunks);
+    for (size_t from = 0; from < count; from += PREWARM_CHUNK_SIZE) {
+        const size_t to = std::min(from + PREWARM_CHUNK_SIZE, count);
+        tasks.push_back([this, rf, job, from, to]() {
+            {
+                FontRenderCache::Reader reader(m_renderCache);
+                for (size_t i = from; i < to; ++i) {
+                    glyphImage(rf, job->glyphs[i]);
+                }
+            }
+
+            if (job->chunksLeft.fetch_sub(1) == 1) {
+                job->promise.set_value(job->glyphs.size());
             }
+        });
+    }
+
+    pool()->submit(std::move(tasks));
 
-            glyphLeft += from_f26d6(g.x_advance) * pixelScale;
+    return future;
+}
+
+std::shared_ptr<ThreadPool> FontsEngine::pool() const
+{
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    if (!m_pool) {
+        m_pool = std::make_shared<ThreadPool>(m_workersCount);
+    }
+    return m_pool;
+}
+
+void FontsEngine::setWorkersCount(size_t count)
+{
+    //! NOTE The old pool finishes its tasks outside of the lock
+    std::shared_ptr<ThreadPool> old;
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_workersCount = count;
+        old = std::move(m_pool);
+    }
+}
+
+FontsEngine::SdfDiff FontsEngine::compareSdfWithReference(const mu::draw::Font& f, size_t glyphStep) const
+{
+    SdfDiff diff;
+
+    const RequireFace* rf = fontFace(f);
+    IF_ASSERT_FAILED(rf && rf->face) {
+        return diff;
+    }
+
+    const std::vector<glyph_idx_t> glyphs = renderGlyphs(rf->face, {});
+    double sum = 0.0;
+    for (size_t i = 0; i < glyphs.size(); i += std::max(glyphStep, size_t(1))) {
+        GlyphImage image;
+        generateSdf(image, glyphs[i], rf->face, SdfParams());
+        GlyphImage ref;
+        generateSdfReference(ref, glyphs[i], rf->face, SdfParams());
+
+        if (image.sdf.bitmap.size() != ref.sdf.bitmap.size()) {
+            LOGE() << "different size of sdf, glyph: " << glyphs[i];
+            diff.maxDiff = 255;
+            continue;
         }
 
-        glyphTop += (pixelSize * TEXT_LINE_SCALE);
+        const uint8_t* a = image.sdf.bitmap.constData();
+        const uint8_t* b = ref.sdf.bitmap.constData();
+        for (size_t p = 0; p < ref.sdf.bitmap.size(); ++p) {
+            const int d = std::abs(int(a[p]) - int(b[p]));
+            diff.maxDiff = std::max(diff.maxDiff, d);
+            sum += d;
+        }
+
+        diff.glyphs += 1;
+        diff.pixels += ref.sdf.bitmap.size();
     }
 
-    return images;
+    diff.meanDiff = diff.pixels > 0 ? sum / diff.pixels : 0.0;
+    return diff;
 }
 
 void FontsEngine::setFontFaceFactory(const FontFaceFactory& f)
@@ -411,6 +831,33 @@ void FontsEngine::setFontFaceFactory(const FontFaceFactory& f)
     m_fontFaceFactory = f;
 }
 
+void FontsEngine::setRenderCacheDirPath(const mu::io::path_t& path)
+{
+    m_renderCache.setResourceCacheEnabled(false);
+    m_renderCache.setCacheDirPath(path);
+    m_renderCache.init();
+}
+
+mu::io::path_t FontsEngine::renderCachePackPath() const
+{
+    return m_renderCache.packFilePath();
+}
+
+void FontsEngine::setRenderCacheMemoryBudget(size_t bytes)
+{
+    m_renderCache.setMemoryBudget(bytes);
+}
+
+void FontsEngine::setAtlasMemoryBudget(size_t bytes)
+{
+    m_atlas.setMemoryBudget(bytes);
+}
+
+FontRenderCache::Stats FontsEngine::renderCacheStats() const
+{
+    return m_renderCache.stats();
+}
+
 IFontFace* FontsEngine::createFontFace(const mu::io::path_t& path) const
 {
     if (m_fontFaceFactory) {
@@ -427,7 +874,88 @@ IFontFace* FontsEngine::createFontFace(const mu::io::path_t& path) const
     return new FontFaceDU(origin);
 }
 
+FontHandle FontsEngine::resolve(const mu::draw::Font& f) const
+{
+    FontHandle h;
+    h.d = fontFace(f);
+    return h;
+}
+
+const FontsEngine::RequireFace* FontsEngine::textFace(const FontHandle& h) const
+{
+    return static_cast<const RequireFace*>(h.d);
+}
+
+const FontsEngine::RequireFace* FontsEngine::symbolFace(const FontHandle& h) const
+{
+    const RequireFace* rf = textFace(h);
+    if (!rf) {
+        return nullptr;
+    }
+
+    RequireFace* sf = rf->symbolFace.load(std::memory_order_acquire);
+    if (!sf) {
+        //! NOTE The symbol face depends only on the data key and the type,
+        //! so it's the same for all fonts that are resolved to this face
+        FaceKey requireKey = rf->requireKey;
+        requireKey.pixelSize = SYMBOLS_PIXEL_SIZE;
+        sf = requireFace(requireKey, true);
+        rf->symbolFace.store(sf, std::memory_order_release);
+    }
+
+    return sf;
+}
+
+static uint64_t nextEngineId()
+{
+    static std::atomic<uint64_t> lastId { 0 };
+    return ++lastId;
+}
+
+FontsEngine::FontsEngine()
+    : m_id(nextEngineId())
+{
+}
+
 FontsEngine::RequireFace* FontsEngine::fontFace(const mu::draw::Font& f, bool isSymbolMode) const
+{
+    //! NOTE The family of the font is a string (interned into the key on the first use),
+    //! layout asks for the same few fonts all the time, so the last resolved ones are remembered
+    //! (per thread, no lock), the found font is not interned and not looked up again.
+    //! The engine id, not the address, so that a new engine does not take the faces of a deleted one
+    static constexpr size_t MEMO_SIZE = 8;
+
+    struct Memo {
+        uint64_t engineId = 0;
+        std::array<mu::draw::Font, MEMO_SIZE> fonts;
+        std::array<bool, MEMO_SIZE> symbolModes {};
+        std::array<RequireFace*, MEMO_SIZE> faces {};
+        size_t next = 0;
+    };
+
+    thread_local Memo memo;
+
+    if (memo.engineId != m_id) {
+        memo = Memo();
+        memo.engineId = m_id;
+    }
+
+    for (size_t i = 0; i < MEMO_SIZE; ++i) {
+        if (memo.faces[i] && memo.symbolModes[i] == isSymbolMode && memo.fonts[i] == f) {
+            return memo.faces[i];
+        }
+    }
+
+    RequireFace* rf = requireFace(requireKeyForFont(f, isSymbolMode), isSymbolMode);
+    memo.fonts[memo.next] = f;
+    memo.symbolModes[memo.next] = isSymbolMode;
+    memo.faces[memo.next] = rf;
+    memo.next = (memo.next + 1) % MEMO_SIZE;
+
+    return rf;
+}
+
+FaceKey FontsEngine::requireKeyForFont(const mu::draw::Font& f, bool isSymbolMode)
 {
     //! NOTE This font is required
     FaceKey requireKey = faceKeyForFont(f);
@@ -449,10 +977,29 @@ FontsEngine::RequireFace* FontsEngine::fontFace(const mu::draw::Font& f, bool is
         requireKey.type = mu::draw::Font::Type::Text;
     }
 
+    return requireKey;
+}
+
+FontsEngine::RequireFace* FontsEngine::requireFace(const FaceKey& requireKey, bool isSymbolMode) const
+{
+    const ModeKey<FaceKey> requireModeKey { requireKey, isSymbolMode };
+
     //! NOTE We are looking for the require font we need among the previously loaded ones
-    for (RequireFace* face : m_requiredFaces) {
-        if (face->requireKey == requireKey && face->isSymbolMode() == isSymbolMode) {
-            return face;
+    {
+        std::shared_lock lock(m_facesMutex);
+        auto it = m_requiredFaces.find(requireModeKey);
+        if (it != m_requiredFaces.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock lock(m_facesMutex);
+
+    //! NOTE Another thread could have added it while we were waiting for the lock
+    {
+        auto it = m_requiredFaces.find(requireModeKey);
+        if (it != m_requiredFaces.end()) {
+            return it->second;
         }
     }
 
@@ -464,57 +1011,54 @@ FontsEngine::RequireFace* FontsEngine::fontFace(const mu::draw::Font& f, bool is
     //! (for example, if there is no required one)
     FontDataKey actualDataKey = fontsDatabase()->actualFont(requireKey.dataKey, requireKey.type);
 
-    //! NOTE We are looking for the font face we real need among the previously loaded ones
-    //! IMPORTANT We use font faces with a fixed pixelSize, so we need to find the right face only from the data
-    IFontFace* face = nullptr;
-    for (IFontFace* f : m_loadedFaces) {
-        if (f->key().dataKey == actualDataKey && f->isSymbolMode() == isSymbolMode) {
-            face = f;
-            break;
-        }
-    }
+    IFontFace* face = loadedFace(actualDataKey, requireKey.type, isSymbolMode);
 
-    //! NOTE If we haven't found a face, we'll create a new one
+    //! NOTE If the font file is missing or corrupt, the default font of the type is used,
+    //! if it can't be loaded too, the face stays null and nothing is rendered
     if (!face) {
-        mu::io::path_t fontPath = fontsDatabase()->fontPath(requireKey.dataKey, requireKey.type);
-        IF_ASSERT_FAILED(!fontPath.empty()) {
-            return nullptr;
+        const FontDataKey defaultDataKey = fontsDatabase()->actualFont(FontDataKey(), requireKey.type);
+        if (defaultDataKey != actualDataKey) {
+            LOGW() << "failed load font: " << actualDataKey.family() << ", will be used: " << defaultDataKey.family();
+            face = loadedFace(defaultDataKey, requireKey.type, isSymbolMode);
         }
-
-        FaceKey loadedKey;
-        loadedKey.dataKey = actualDataKey;
-        loadedKey.type = requireKey.type;
-        loadedKey.pixelSize = LOADED_PIXEL_SIZE;
-
-        face = createFontFace(fontPath);
-
-        face->load(loadedKey, fontPath, isSymbolMode);
-        m_loadedFaces.push_back(face);
     }
 
     newFont->face = face;
-    m_requiredFaces.push_back(newFont);
+    m_requiredFaces.emplace(requireModeKey, newFont);
 
     return newFont;
 }
 
-std::vector<FontsEngine::TextLine> FontsEngine::splitTextByLines(const std::u32string& text) const
+IFontFace* FontsEngine::loadedFace(const FontDataKey& dataKey, mu::draw::Font::Type type, bool isSymbolMode) const
 {
-    std::vector<TextLine> lines;
+    //! NOTE We are looking for the font face we real need among the previously loaded ones
+    //! IMPORTANT We use font faces with a fixed pixelSize, so we need to find the right face only from the data
+    const ModeKey<FontDataKey> loadedModeKey { dataKey, isSymbolMode };
+    auto lit = m_loadedFaces.find(loadedModeKey);
+    if (lit != m_loadedFaces.end()) {
+        return lit->second;
+    }
 
-    TextLine l;
-    for (size_t i = 0; i < text.size(); ++i) {
-        if (!l.text) {
-            l.text = &text[i];
-        }
-        ++l.lenght;
+    //! NOTE If we haven't found a face, we'll create a new one
+    mu::io::path_t fontPath = fontsDatabase()->fontPath(dataKey, type);
+    IF_ASSERT_FAILED(!fontPath.empty()) {
+        return nullptr;
+    }
 
-        if (i == (text.size() - 1) || text.at(i) == U'\n') {
-            lines.push_back(l);
-            l.text = nullptr;
-            l.lenght = 0;
-        }
+    FaceKey loadedKey;
+    loadedKey.dataKey = dataKey;
+    loadedKey.type = type;
+    loadedKey.pixelSize = LOADED_PIXEL_SIZE;
+
+    IFontFace* face = createFontFace(fontPath);
+    if (!face->load(loadedKey, fontPath, isSymbolMode)) {
+        LOGE() << "failed load font face: " << fontPath;
+        delete face;
+        face = nullptr;
     }
 
-    return lines;
+    //! NOTE A failed face is remembered as null, so the file is not loaded again on every require
+    m_loadedFaces.emplace(loadedModeKey, face);
+
+    return face;
 }
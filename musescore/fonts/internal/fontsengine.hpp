@@ -2,7 +2,12 @@
 #define XTZ_FONTS_FONTSENGINE_HPP
 
 #include <map>
+#include <atomic>
+#include <unordered_map>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 
 #include "../ifontsengine.hpp"
 
@@ -10,19 +15,23 @@
 #include "fonts/ifontsdatabase.hpp"
 
 #include "fontrendercache.hpp"
+#include "glyphatlas.hpp"
 
 namespace xtz::fonts {
 class IFontFace;
+class ThreadPool;
 class FontsEngine : public IFontsEngine
 {
     INJECT(xtz::fonts, IFontsDatabase, fontsDatabase)
 
 public:
-    FontsEngine() = default;
+    FontsEngine();
     ~FontsEngine();
 
     void init();
 
+    FontHandle resolve(const mu::draw::Font& f) const override;
+
     double lineSpacing(const mu::draw::Font& f) const override;
     double xHeight(const mu::draw::Font& f) const override;
     double height(const mu::draw::Font& f) const override;
@@ -32,49 +41,139 @@ public:
     bool inFontUcs4(const mu::draw::Font& f, char32_t ucs4) const override;
 
     double horizontalAdvance(const mu::draw::Font& f, const char32_t& ch) const override;
-    double horizontalAdvance(const mu::draw::Font& f, const std::u32string& text) const override;
+    double horizontalAdvance(const mu::draw::Font& f, std::u32string_view text) const override;
 
     mu::RectF boundingRect(const mu::draw::Font& f, const char32_t& ch) const override;
-    mu::RectF boundingRect(const mu::draw::Font& f, const std::u32string& text) const override;
-    mu::RectF tightBoundingRect(const mu::draw::Font& f, const std::u32string& text) const override;
+    mu::RectF boundingRect(const mu::draw::Font& f, std::u32string_view text) const override;
+    mu::RectF tightBoundingRect(const mu::draw::Font& f, std::u32string_view text) const override;
 
     // Score symbols
     mu::RectF symBBox(const mu::draw::Font& f, char32_t ucs4) const override;
     double symAdvance(const mu::draw::Font& f, char32_t ucs4) const override;
 
+    // Resolved font
+    double lineSpacing(const FontHandle& h) const override;
+    double xHeight(const FontHandle& h) const override;
+    double height(const FontHandle& h) const override;
+    double ascent(const FontHandle& h) const override;
+    double descent(const FontHandle& h) const override;
+
+    bool inFontUcs4(const FontHandle& h, char32_t ucs4) const override;
+
+    double horizontalAdvance(const FontHandle& h, const char32_t& ch) const override;
+    double horizontalAdvance(const FontHandle& h, std::u32string_view text) const override;
+
+    mu::RectF boundingRect(const FontHandle& h, const char32_t& ch) const override;
+    mu::RectF boundingRect(const FontHandle& h, std::u32string_view text) const override;
+    mu::RectF tightBoundingRect(const FontHandle& h, std::u32string_view text) const override;
+
+    mu::RectF symBBox(const FontHandle& h, char32_t ucs4) const override;
+    double symAdvance(const FontHandle& h, char32_t ucs4) const override;
+
+    // Batch
+    std::vector<SymMetrics> symMetrics(const mu::draw::Font& f, const std::vector<char32_t>& codes) const override;
+    std::vector<SymMetrics> symMetrics(const FontHandle& h, const std::vector<char32_t>& codes) const override;
+
     // For draw
-    std::vector<GlyphImage> render(const mu::draw::Font& f, const std::u32string& text) const override;
+    void setSdfParams(mu::draw::Font::Type type, const SdfParams& params) override;
+    SdfParams sdfParams(mu::draw::Font::Type type) const override;
+
+    std::vector<AtlasGlyph> render(const mu::draw::Font& f, std::u32string_view text) const override;
+
+    uint32_t atlasGeneration() const override;
+    size_t atlasPagesCount() const override;
+    bool readAtlasPage(uint32_t page, const std::function<void(const AtlasPage&)>& func) const override;
+    bool defragmentAtlas(double minWasteRatio = 0.5) override;
+
+    std::shared_future<size_t> prewarm(const mu::draw::Font& f, const std::vector<char32_t>& codes = {}) const override;
 
     // For dev
     using FontFaceFactory = std::function<IFontFace* (const mu::io::path_t&)>;
     void setFontFaceFactory(const FontFaceFactory& f);
 
-private:
-
-    struct TextLine {
-        const char32_t* text = nullptr;
-        int lenght = 0;
+    //! NOTE Renders into the cache in the given dir, without the resource cache
+    //! (for the SDF cache generator)
+    void setRenderCacheDirPath(const mu::io::path_t& path);
+    mu::io::path_t renderCachePackPath() const;
+
+    void setRenderCacheMemoryBudget(size_t bytes);
+    FontRenderCache::Stats renderCacheStats() const;
+    void setAtlasMemoryBudget(size_t bytes);
+
+    //! NOTE 0 - hardware concurrency, waits for the queued prewarm
+    void setWorkersCount(size_t count);
+
+    //! NOTE Compares the SDF of the glyphs with msdfgen::generateSDF (slow),
+    //! each glyphStep-th glyph of the font
+    struct SdfDiff {
+        size_t glyphs = 0;
+        size_t pixels = 0;
+        int maxDiff = 0;
+        double meanDiff = 0.0;
     };
+    SdfDiff compareSdfWithReference(const mu::draw::Font& f, size_t glyphStep = 1) const;
+
+private:
 
     struct RequireFace {
         IFontFace* face = nullptr;   // real loaded face
         FaceKey requireKey;          // require face
 
+        //! NOTE The symbol mode face of the same font, resolved on first use
+        mutable std::atomic<RequireFace*> symbolFace { nullptr };
+
         bool isSymbolMode() const;
         double pixelScale() const;
     };
 
+    //! NOTE The same key can be required in text and in symbol mode
+    template<typename K>
+    struct ModeKey {
+        K key;
+        bool isSymbolMode = false;
+
+        inline bool operator==(const ModeKey& o) const { return isSymbolMode == o.isSymbolMode && key == o.key; }
+    };
+
+    template<typename K>
+    struct ModeKeyHash {
+        size_t operator()(const ModeKey<K>& k) const { return hashCombine(k.key.hash(), static_cast<size_t>(k.isSymbolMode)); }
+    };
+
     IFontFace* createFontFace(const mu::io::path_t& path) const;
     RequireFace* fontFace(const mu::draw::Font& f, bool isSymbolMode = false) const;
+    static FaceKey requireKeyForFont(const mu::draw::Font& f, bool isSymbolMode);
+    RequireFace* requireFace(const FaceKey& requireKey, bool isSymbolMode) const;
+    //! NOTE Expects m_facesMutex to be locked exclusively, returns null if the face can't be loaded
+    IFontFace* loadedFace(const FontDataKey& dataKey, mu::draw::Font::Type type, bool isSymbolMode) const;
+
+    const RequireFace* textFace(const FontHandle& h) const;
+    const RequireFace* symbolFace(const FontHandle& h) const;
 
-    std::vector<TextLine> splitTextByLines(const std::u32string& text) const;
+    //! NOTE The image can be a view into a pack, the caller holds a FontRenderCache::Reader while it uses it
+    GlyphImage glyphImage(const RequireFace* rf, glyph_idx_t glyphIdx) const;
+    std::shared_ptr<ThreadPool> pool() const;
 
+    const uint64_t m_id = 0;
     FontFaceFactory m_fontFaceFactory;
 
-    mutable std::vector<IFontFace*> m_loadedFaces;
-    mutable std::vector<RequireFace*> m_requiredFaces;
+    //! NOTE Faces are only added, never removed (until destruction),
+    //! so the found pointers remain valid after the lock is released
+    mutable std::shared_mutex m_facesMutex;
+    mutable std::unordered_map<ModeKey<FontDataKey>, IFontFace*, ModeKeyHash<FontDataKey> > m_loadedFaces;
+    mutable std::unordered_map<ModeKey<FaceKey>, RequireFace*, ModeKeyHash<FaceKey> > m_requiredFaces;
 
     mutable FontRenderCache m_renderCache;
+    mutable GlyphAtlas m_atlas;
+
+    mutable std::shared_mutex m_sdfParamsMutex;
+    std::map<mu::draw::Font::Type, SdfParams> m_sdfParams;
+
+    //! NOTE Created on first prewarm, shared with the callers,
+    //! so a pool replaced by setWorkersCount lives until its last submit is done
+    mutable std::mutex m_poolMutex;
+    mutable std::shared_ptr<ThreadPool> m_pool;
+    size_t m_workersCount = 0;
 };
 }
 
@@ -0,0 +1,525 @@
+#include "glyphatlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "log.h"
+
+using namespace xtz::fonts;
+
+static const uint32_t INITIAL_PAGE_SIZE = 512;
+static const uint32_t MAX_PAGE_SIZE = 2048;
+
+//! NOTE Between the glyphs, so that the linear filtering does not take the neighbour
+static const uint32_t GLYPH_PADDING = 1;
+
+bool GlyphAtlas::find(const FaceKey& face, glyph_idx_t glyphIdx, AtlasGlyph& glyph) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    auto fit = m_entries.find(face);
+    if (fit == m_entries.end()) {
+        return false;
+    }
+
+    auto eit = fit->second.find(glyphIdx);
+    if (eit == fit->second.end()) {
+        return false;
+    }
+
+    const Entry& e = eit->second;
+    if (e.slot != NO_SLOT) {
+        m_slots[e.slot].referenced.store(true, std::memory_order_relaxed);
+    }
+
+    glyph = toGlyph(e);
+    return true;
+}
+
+AtlasGlyph GlyphAtlas::insert(const FaceKey& face, glyph_idx_t glyphIdx, const GlyphImage& image)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    Entries& entries = m_entries[face];
+
+    //! NOTE Another thread could have added this glyph at the same time
+    auto it = entries.find(glyphIdx);
+    if (it != entries.end()) {
+        return toGlyph(it->second);
+    }
+
+    Entry e;
+    e.rect = image.rect;
+
+    const Sdf& sdf = image.sdf;
+    if (sdf.width > 0 && sdf.height > 0) {
+        if (sdf.bitmap.size() != size_t(sdf.width) * sdf.height * sdf.channels) {
+            LOGE() << "unexpected size of sdf bitmap, glyph: " << glyphIdx;
+        } else if (place(sdf.format, sdf.channels, sdf.width, sdf.height, e.page, e.texRect)) {
+            blit(m_pages[e.page], e.texRect, sdf.bitmap.constData());
+            m_usedTexels += size_t(sdf.width) * sdf.height;
+            e.slot = takeSlot(face, glyphIdx, sdf.bitmap.size());
+        } else {
+            LOGE() << "glyph does not fit atlas page, glyph: " << glyphIdx << ", size: " << sdf.width << "x" << sdf.height;
+        }
+    }
+
+    Entry& added = entries[glyphIdx];
+    added = e;
+
+    //! NOTE Evicted down to the half of the budget, so that the defragmentation (repacks all pages) is not on each insert
+    if (pagesBytes() > m_budget) {
+        evict(added.slot);
+        defragmentLocked();
+    }
+
+    return toGlyph(added);
+}
+
+void GlyphAtlas::remove(mu::draw::Font::Type type)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->first.type != type) {
+            ++it;
+            continue;
+        }
+
+        for (const auto& p : it->second) {
+            m_usedTexels -= size_t(p.second.texRect.width) * p.second.texRect.height;
+            if (p.second.slot != NO_SLOT) {
+                freeSlot(p.second.slot);
+            }
+        }
+        it = m_entries.erase(it);
+    }
+}
+
+void GlyphAtlas::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    m_entries.clear();
+    m_pages.clear();
+    m_usedTexels = 0;
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_clockHand = 0;
+    m_usedBytes = 0;
+    ++m_generation;
+}
+
+double GlyphAtlas::wasteRatio() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    size_t total = 0;
+    for (const Page& p : m_pages) {
+        total += size_t(p.width) * p.height;
+    }
+
+    return total > 0 ? 1.0 - double(m_usedTexels) / double(total) : 0.0;
+}
+
+void GlyphAtlas::defragment()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    defragmentLocked();
+}
+
+void GlyphAtlas::defragmentLocked()
+{
+    struct Item {
+        Entry* entry = nullptr;
+        SdfFormat format = SdfFormat::Sdf;
+        uint8_t channels = 1;
+    };
+
+    std::vector<Item> items;
+    for (auto& f : m_entries) {
+        for (auto& g : f.second) {
+            if (!g.second.texRect.isEmpty()) {
+                const Page& page = m_pages[g.second.page];
+                items.push_back({ &g.second, page.format, page.channels });
+            }
+        }
+    }
+
+    //! NOTE The skyline packs tighter when the tall glyphs go first
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+        if (a.entry->texRect.height != b.entry->texRect.height) {
+            return a.entry->texRect.height > b.entry->texRect.height;
+        }
+        return a.entry->texRect.width > b.entry->texRect.width;
+    });
+
+    std::vector<Page> oldPages;
+    oldPages.swap(m_pages);
+
+    std::vector<uint8_t> buf;
+    for (const Item& item : items) {
+        Entry& e = *item.entry;
+        const Page& from = oldPages[e.page];
+        const size_t rowSize = size_t(e.texRect.width) * from.channels;
+
+        buf.resize(rowSize * e.texRect.height);
+        for (uint32_t row = 0; row < e.texRect.height; ++row) {
+            const uint8_t* src = from.pixels.data() + ((size_t(e.texRect.y) + row) * from.width + e.texRect.x) * from.channels;
+            std::memcpy(buf.data() + row * rowSize, src, rowSize);
+        }
+
+        const uint32_t width = e.texRect.width;
+        const uint32_t height = e.texRect.height;
+        if (!place(item.format, item.channels, width, height, e.page, e.texRect)) {
+            //! NOTE Not expected, it fitted before
+            LOGE() << "glyph does not fit atlas page on defragmentation";
+            e.texRect = AtlasRect();
+            m_usedTexels -= size_t(width) * height;
+            freeSlot(e.slot);
+            e.slot = NO_SLOT;
+            continue;
+        }
+
+        blit(m_pages[e.page], e.texRect, buf.data());
+    }
+
+    ++m_generation;
+
+    LOGD() << "atlas defragmented, glyphs: " << items.size() << ", pages: " << oldPages.size() << " -> " << m_pages.size();
+}
+
+void GlyphAtlas::setMemoryBudget(size_t bytes)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_budget = bytes;
+
+    if (pagesBytes() > m_budget) {
+        evict(NO_SLOT);
+        defragmentLocked();
+    }
+}
+
+size_t GlyphAtlas::memoryBudget() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_budget;
+}
+
+size_t GlyphAtlas::takeSlot(const FaceKey& face, glyph_idx_t glyphIdx, size_t bytes)
+{
+    size_t idx = 0;
+    if (!m_freeSlots.empty()) {
+        idx = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        idx = m_slots.size();
+        m_slots.emplace_back();
+    }
+
+    Slot& slot = m_slots[idx];
+    slot.face = face;
+    slot.glyph = glyphIdx;
+    slot.bytes = bytes;
+    slot.used = true;
+    //! NOTE Not referenced, so a glyph that is not drawn again is evicted on the first pass
+    slot.referenced.store(false, std::memory_order_relaxed);
+
+    m_usedBytes += bytes;
+    return idx;
+}
+
+void GlyphAtlas::freeSlot(size_t idx)
+{
+    Slot& slot = m_slots[idx];
+    m_usedBytes -= slot.bytes;
+    slot.bytes = 0;
+    slot.used = false;
+    m_freeSlots.push_back(idx);
+}
+
+void GlyphAtlas::evict(size_t keepSlot)
+{
+    if (m_slots.empty()) {
+        return;
+    }
+
+    //! NOTE Two passes at most: the first one may only clear the referenced bits
+    const size_t target = m_budget / 2;
+    size_t steps = m_slots.size() * 2;
+    size_t evicted = 0;
+    while (m_usedBytes > target && steps-- > 0) {
+        const size_t idx = m_clockHand;
+        Slot& slot = m_slots[idx];
+        m_clockHand = (m_clockHand + 1) % m_slots.size();
+
+        if (!slot.used || idx == keepSlot) {
+            continue;
+        }
+
+        if (slot.referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+
+        //! NOTE The empty glyph maps of the faces are kept, they are few
+        Entries& entries = m_entries[slot.face];
+        auto it = entries.find(slot.glyph);
+        IF_ASSERT_FAILED(it != entries.end()) {
+            continue;
+        }
+
+        m_usedTexels -= size_t(it->second.texRect.width) * it->second.texRect.height;
+        entries.erase(it);
+        freeSlot(idx);
+        ++evicted;
+    }
+
+    LOGD() << "atlas glyphs evicted: " << evicted << ", used bytes: " << m_usedBytes << ", budget: " << m_budget;
+}
+
+size_t GlyphAtlas::pagesBytes() const
+{
+    size_t bytes = 0;
+    for (const Page& p : m_pages) {
+        bytes += p.pixels.size();
+    }
+    return bytes;
+}
+
+uint32_t GlyphAtlas::generation() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_generation;
+}
+
+size_t GlyphAtlas::pagesCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_pages.size();
+}
+
+bool GlyphAtlas::readPage(uint32_t page, const std::function<void(const AtlasPage&)>& func) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    if (page >= m_pages.size()) {
+        return false;
+    }
+
+    const Page& p = m_pages[page];
+    AtlasPage view;
+    view.data = p.pixels.data();
+    view.width = p.width;
+    view.height = p.height;
+    view.channels = p.channels;
+    view.format = p.format;
+    view.revision = p.revision;
+
+    func(view);
+    return true;
+}
+
+AtlasGlyph GlyphAtlas::toGlyph(const Entry& e) const
+{
+    AtlasGlyph g;
+    g.rect = e.rect;
+    g.page = e.page;
+    g.texRect = e.texRect;
+    g.generation = m_generation;
+    return g;
+}
+
+bool GlyphAtlas::fit(const Page& page, size_t nodeIdx, uint32_t width, uint32_t height, uint32_t& y)
+{
+    const uint32_t x = page.skyline[nodeIdx].x;
+    if (x + width > page.width) {
+        return false;
+    }
+
+    //! NOTE The rect lies on the highest of the segments under it
+    y = 0;
+    uint32_t widthLeft = width;
+    for (size_t i = nodeIdx; widthLeft > 0; ++i) {
+        if (i >= page.skyline.size()) {
+            return false;
+        }
+
+        const Node& n = page.skyline[i];
+        y = std::max(y, n.y);
+        if (y + height > page.height) {
+            return false;
+        }
+
+        widthLeft -= std::min(widthLeft, n.width);
+    }
+
+    return true;
+}
+
+bool GlyphAtlas::allocate(Page& page, uint32_t width, uint32_t height, AtlasRect& rect)
+{
+    // bottom-left: the lowest top, then the leftmost
+    size_t bestIdx = page.skyline.size();
+    uint32_t bestTop = UINT32_MAX;
+    uint32_t bestY = 0;
+    for (size_t i = 0; i < page.skyline.size(); ++i) {
+        uint32_t y = 0;
+        if (fit(page, i, width, height, y) && y + height < bestTop) {
+            bestIdx = i;
+            bestTop = y + height;
+            bestY = y;
+        }
+    }
+
+    if (bestIdx == page.skyline.size()) {
+        return false;
+    }
+
+    const uint32_t x = page.skyline[bestIdx].x;
+
+    page.skyline.insert(page.skyline.begin() + bestIdx, Node { x, bestTop, width });
+
+    // the segments under the rect are cut
+    const uint32_t right = x + width;
+    for (size_t i = bestIdx + 1; i < page.skyline.size();) {
+        Node& n = page.skyline[i];
+        if (n.x >= right) {
+            break;
+        }
+
+        const uint32_t nRight = n.x + n.width;
+        if (nRight <= right) {
+            page.skyline.erase(page.skyline.begin() + i);
+            continue;
+        }
+
+        n.width = nRight - right;
+        n.x = right;
+        break;
+    }
+
+    // merge the segments of the same height
+    for (size_t i = 0; i + 1 < page.skyline.size();) {
+        if (page.skyline[i].y == page.skyline[i + 1].y) {
+            page.skyline[i].width += page.skyline[i + 1].width;
+            page.skyline.erase(page.skyline.begin() + i + 1);
+        } else {
+            ++i;
+        }
+    }
+
+    rect.x = static_cast<uint16_t>(x);
+    rect.y = static_cast<uint16_t>(bestY);
+    return true;
+}
+
+bool GlyphAtlas::grow(Page& page, uint64_t revision)
+{
+    if (page.width >= MAX_PAGE_SIZE && page.height >= MAX_PAGE_SIZE) {
+        return false;
+    }
+
+    //! NOTE The texel rects of the glyphs remain the same,
+    //! the rows are appended, or the rows are widened to the right
+    if (page.width <= page.height && page.width < MAX_PAGE_SIZE) {
+        const uint32_t width = page.width * 2;
+        std::vector<uint8_t> pixels(size_t(width) * page.height * page.channels, 0);
+        const size_t rowSize = size_t(page.width) * page.channels;
+        for (uint32_t row = 0; row < page.height; ++row) {
+            std::memcpy(pixels.data() + row * size_t(width) * page.channels, page.pixels.data() + row * rowSize, rowSize);
+        }
+        page.pixels.swap(pixels);
+
+        if (!page.skyline.empty() && page.skyline.back().y == 0) {
+            page.skyline.back().width += width - page.width;
+        } else {
+            page.skyline.push_back(Node { page.width, 0, width - page.width });
+        }
+        page.width = width;
+    } else {
+        page.height *= 2;
+        page.pixels.resize(size_t(page.width) * page.height * page.channels, 0);
+    }
+
+    page.revision = revision;
+    return true;
+}
+
+void GlyphAtlas::addPage(SdfFormat format, uint8_t channels)
+{
+    Page page;
+    page.width = INITIAL_PAGE_SIZE;
+    page.height = INITIAL_PAGE_SIZE;
+    page.channels = channels;
+    page.format = format;
+    page.pixels.resize(size_t(page.width) * page.height * channels, 0);
+    page.skyline.push_back(Node { 0, 0, page.width });
+    m_pages.push_back(std::move(page));
+}
+
+bool GlyphAtlas::place(SdfFormat format, uint8_t channels, uint32_t width, uint32_t height, uint32_t& pageIdx, AtlasRect& rect)
+{
+    const uint32_t paddedWidth = width + GLYPH_PADDING;
+    const uint32_t paddedHeight = height + GLYPH_PADDING;
+    if (paddedWidth > MAX_PAGE_SIZE || paddedHeight > MAX_PAGE_SIZE) {
+        return false;
+    }
+
+    auto isPageOfFormat = [&](const Page& page) {
+        return page.format == format && page.channels == channels;
+    };
+
+    // only the last page of the format grows, the others have reached the max size
+    size_t lastIdx = m_pages.size();
+    for (size_t i = 0; i < m_pages.size(); ++i) {
+        if (isPageOfFormat(m_pages[i])) {
+            lastIdx = i;
+        }
+    }
+
+    auto tryPage = [&](size_t i) {
+        Page& page = m_pages[i];
+        if (!isPageOfFormat(page)) {
+            return false;
+        }
+
+        do {
+            if (allocate(page, paddedWidth, paddedHeight, rect)) {
+                pageIdx = static_cast<uint32_t>(i);
+                return true;
+            }
+        } while (i == lastIdx && grow(page, ++m_revision));
+
+        return false;
+    };
+
+    for (size_t i = 0; i < m_pages.size(); ++i) {
+        if (tryPage(i)) {
+            rect.width = static_cast<uint16_t>(width);
+            rect.height = static_cast<uint16_t>(height);
+            return true;
+        }
+    }
+
+    addPage(format, channels);
+    lastIdx = m_pages.size() - 1;
+    if (tryPage(lastIdx)) {
+        rect.width = static_cast<uint16_t>(width);
+        rect.height = static_cast<uint16_t>(height);
+        return true;
+    }
+
+    return false;
+}
+
+void GlyphAtlas::blit(Page& page, const AtlasRect& rect, const uint8_t* data)
+{
+    const size_t rowSize = size_t(rect.width) * page.channels;
+    for (uint32_t row = 0; row < rect.height; ++row) {
+        uint8_t* dst = page.pixels.data() + ((size_t(rect.y) + row) * page.width + rect.x) * page.channels;
+        std::memcpy(dst, data + row * rowSize, rowSize);
+    }
+
+    page.revision = ++m_revision;
+}
@@ -0,0 +1,127 @@
+#ifndef XTZ_FONTS_GLYPHATLAS_H
+#define XTZ_FONTS_GLYPHATLAS_H
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <unordered_map>
+#include <shared_mutex>
+#include <functional>
+
+#include "fonts/fontstypes.hpp"
+
+namespace xtz::fonts {
+//! NOTE The SDF images of the glyphs packed into large pages, so that the text is drawn
+//! from a few textures (batched) and the glyphs do not own their bitmaps.
+//! Pages are packed with a skyline (bottom-left), a page starts small and grows
+//! (the texel rects of the glyphs do not change), when it has reached the max size, a new page is added.
+//! Each page holds a single SDF format.
+//! Removed glyphs leave holes, they are reused only after defragmentation,
+//! which repacks the remaining glyphs into new pages and changes the generation.
+//! The pages are bounded by the memory budget: when they are over it, the glyphs not used recently
+//! are evicted (CLOCK) and the atlas is defragmented, the evicted glyphs are inserted again from the render cache.
+//! Thread safe.
+class GlyphAtlas
+{
+public:
+    GlyphAtlas() = default;
+
+    GlyphAtlas(const GlyphAtlas&) = delete;
+    GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+    bool find(const FaceKey& face, glyph_idx_t glyphIdx, AtlasGlyph& glyph) const;
+    //! NOTE The bitmap of the image is copied into a page.
+    //! If the glyph is already added (by another thread), the added one is returned
+    AtlasGlyph insert(const FaceKey& face, glyph_idx_t glyphIdx, const GlyphImage& image);
+
+    void remove(mu::draw::Font::Type type);
+    void clear();
+
+    //! NOTE The part of the pages area that is not taken by the glyphs
+    //! (removed glyphs and the packing waste), to decide on defragmentation
+    double wasteRatio() const;
+    //! NOTE The atlas glyphs returned before become invalid
+    void defragment();
+
+    //! NOTE The bytes of the pages
+    void setMemoryBudget(size_t bytes);
+    size_t memoryBudget() const;
+
+    uint32_t generation() const;
+    size_t pagesCount() const;
+    bool readPage(uint32_t page, const std::function<void(const AtlasPage&)>& func) const;
+
+private:
+
+    // skyline segment, y is the top of the taken area
+    struct Node {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+    };
+
+    struct Page {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint8_t channels = 1;
+        SdfFormat format = SdfFormat::Sdf;
+        std::vector<uint8_t> pixels;
+        std::vector<Node> skyline;
+        uint64_t revision = 0;
+    };
+
+    static constexpr size_t NO_SLOT = SIZE_MAX;
+
+    struct Entry {
+        mu::RectF rect;
+        uint32_t page = 0;
+        AtlasRect texRect;
+        size_t slot = NO_SLOT;      // the glyphs without image are not evicted
+    };
+
+    //! NOTE CLOCK, as in FontRenderCache: find sets the referenced bit (under the shared lock),
+    //! the hand clears it, the not referenced glyph is evicted
+    struct Slot {
+        FaceKey face;
+        glyph_idx_t glyph = 0;
+        size_t bytes = 0;
+        bool used = false;
+        mutable std::atomic<bool> referenced { false };
+    };
+
+    using Entries = std::unordered_map<glyph_idx_t, Entry>;
+
+    static bool fit(const Page& page, size_t nodeIdx, uint32_t width, uint32_t height, uint32_t& y);
+    static bool allocate(Page& page, uint32_t width, uint32_t height, AtlasRect& rect);
+    static bool grow(Page& page, uint64_t revision);
+
+    void addPage(SdfFormat format, uint8_t channels);
+    bool place(SdfFormat format, uint8_t channels, uint32_t width, uint32_t height, uint32_t& pageIdx, AtlasRect& rect);
+    void blit(Page& page, const AtlasRect& rect, const uint8_t* data);
+
+    AtlasGlyph toGlyph(const Entry& e) const;
+
+    // expect the unique lock
+    size_t takeSlot(const FaceKey& face, glyph_idx_t glyphIdx, size_t bytes);
+    void freeSlot(size_t idx);
+    void evict(size_t keepSlot);
+    void defragmentLocked();
+    size_t pagesBytes() const;
+
+    mutable std::shared_mutex m_mutex;
+    std::vector<Page> m_pages;
+    std::unordered_map<FaceKey, Entries> m_entries;
+    uint32_t m_generation = 0;
+    uint64_t m_revision = 0;
+    size_t m_usedTexels = 0;
+
+    //! NOTE deque, so the slots (with atomics) are not moved
+    std::deque<Slot> m_slots;
+    std::vector<size_t> m_freeSlots;
+    size_t m_clockHand = 0;
+    size_t m_usedBytes = 0;     // of the glyphs in the slots
+    size_t m_budget = 64 * 1024 * 1024;
+};
+}
+
+#endif // XTZ_FONTS_GLYPHATLAS_H
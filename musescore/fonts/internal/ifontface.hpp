@@ -2,6 +2,7 @@
 #define XTZ_FONTS_IFONTFACE_HPP
 
 #include <memory>
+#include <vector>
 
 #include <msdfgen.h>
 
@@ -9,6 +10,8 @@
 #include "io/path.h"
 
 namespace xtz::fonts {
+class CodepointCoverage;
+
 using f26dot6_t = long;         // A signed 26.6 fixed-point type used for vectorial pixel coordinates.
 
 inline long to_f26d6(float v) { return static_cast<long>(v * 64); }
@@ -21,6 +24,48 @@ struct GlyphPos {
     f26dot6_t x_advance = 0.;
 };
 
+using GlyphRun = std::vector<GlyphPos>;
+using GlyphRunPtr = std::shared_ptr<const GlyphRun>;
+
+//! NOTE The glyphs of a text: a shared immutable run (of the shaping cache, not copied)
+//! or the own buffer, that the caller reuses, so that memory is not allocated every time
+class Glyphs
+{
+public:
+    Glyphs() = default;
+
+    void setRun(GlyphRunPtr run) { m_run = std::move(run); }
+    //! NOTE Cleared, to be filled
+    GlyphRun& buffer()
+    {
+        m_run.reset();
+        m_buffer.clear();
+        return m_buffer;
+    }
+
+    //! NOTE To change the glyphs, a shared run is copied into the buffer
+    GlyphRun& detach()
+    {
+        if (m_run) {
+            m_buffer.assign(m_run->begin(), m_run->end());
+            m_run.reset();
+        }
+        return m_buffer;
+    }
+
+    const GlyphRun& run() const { return m_run ? *m_run : m_buffer; }
+
+    GlyphRun::const_iterator begin() const { return run().begin(); }
+    GlyphRun::const_iterator end() const { return run().end(); }
+    size_t size() const { return run().size(); }
+    bool empty() const { return run().empty(); }
+    const GlyphPos& back() const { return run().back(); }
+
+private:
+    GlyphRunPtr m_run;
+    GlyphRun m_buffer;
+};
+
 class IFontFace
 {
 public:
@@ -32,15 +77,23 @@ public:
     virtual const FaceKey& key() const = 0;
     virtual bool isSymbolMode() const = 0;
 
+    //! NOTE Hash of the font file content, the same for all the faces of the file
+    virtual uint64_t contentHash() const = 0;
+
     virtual f26dot6_t leading() const = 0;
     virtual f26dot6_t ascent() const = 0;
     virtual f26dot6_t descent() const = 0;
     virtual f26dot6_t xHeight() const = 0;
 
-    virtual std::vector<GlyphPos> glyphs(const char32_t* text, int text_length) const = 0;
+    //! NOTE The result is replaced (see Glyphs),
+    //! the caller can reuse it, so that memory is not allocated every time
+    virtual void glyphs(const char32_t* text, int text_length, Glyphs& result) const = 0;
     virtual glyph_idx_t glyphIndex(char32_t ucs4) const = 0;
     virtual char32_t findCharCode(glyph_idx_t idx) const = 0; // for tests
 
+    //! NOTE Codepoints mapped by the face, empty if the face is not loaded
+    virtual const CodepointCoverage& coverage() const = 0;
+
     virtual FBBox glyphBbox(glyph_idx_t idx) const = 0;
     virtual f26dot6_t glyphAdvance(glyph_idx_t idx) const = 0;
     virtual const msdfgen::Shape& glyphShape(glyph_idx_t idx) const = 0;
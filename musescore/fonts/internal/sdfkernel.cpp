@@ -0,0 +1,810 @@
+#include "sdfkernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <msdfgen.h>
+
+using namespace xtz::fonts;
+
+#if defined(__AVX512F__)
+static constexpr int LANES = 16;
+#else
+static constexpr int LANES = 8;
+#endif
+
+//! NOTE Limit of the segments of one curve
+static const int MAX_CURVE_SEGMENTS = 64;
+
+// edge colors, channels mask
+static const uint8_t RED = 1;
+static const uint8_t GREEN = 2;
+static const uint8_t BLUE = 4;
+static const uint8_t YELLOW = RED | GREEN;
+static const uint8_t MAGENTA = RED | BLUE;
+static const uint8_t CYAN = GREEN | BLUE;
+static const uint8_t WHITE = RED | GREEN | BLUE;
+
+// segment flags
+static const uint8_t EDGE_START = 1;
+static const uint8_t EDGE_END = 2;
+
+static const uint32_t NO_SEGMENT = UINT32_MAX;
+
+namespace {
+//! NOTE Squared distances from the pixels of a block (a row, from x0) to the segments
+struct Block {
+    alignas(64) float best[LANES];
+
+    const float* ax;
+    const float* ay;
+    const float* dx;
+    const float* dy;
+    const float* invLen2;
+
+    void init(float limit)
+    {
+        for (int l = 0; l < LANES; ++l) {
+            best[l] = limit;
+        }
+    }
+
+#if defined(__AVX512F__)
+
+    void add(uint32_t i, float x0, float y)
+    {
+        const __m512 px = _mm512_add_ps(_mm512_set1_ps(x0),
+                                        _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        const __m512 sdx = _mm512_set1_ps(dx[i]);
+        const __m512 sdy = _mm512_set1_ps(dy[i]);
+
+        const __m512 wx = _mm512_sub_ps(px, _mm512_set1_ps(ax[i]));
+        const __m512 wy = _mm512_set1_ps(y - ay[i]);
+
+        __m512 t = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(wx, sdx), _mm512_mul_ps(wy, sdy)), _mm512_set1_ps(invLen2[i]));
+        t = _mm512_min_ps(_mm512_max_ps(t, _mm512_setzero_ps()), _mm512_set1_ps(1.f));
+
+        const __m512 ex = _mm512_sub_ps(wx, _mm512_mul_ps(t, sdx));
+        const __m512 ey = _mm512_sub_ps(wy, _mm512_mul_ps(t, sdy));
+        const __m512 d2 = _mm512_add_ps(_mm512_mul_ps(ex, ex), _mm512_mul_ps(ey, ey));
+
+        _mm512_store_ps(best, _mm512_min_ps(_mm512_load_ps(best), d2));
+    }
+
+    float farthest() const
+    {
+        return _mm512_reduce_max_ps(_mm512_load_ps(best));
+    }
+
+#elif defined(__AVX2__)
+
+    void add(uint32_t i, float x0, float y)
+    {
+        const __m256 px = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+        const __m256 sdx = _mm256_set1_ps(dx[i]);
+        const __m256 sdy = _mm256_set1_ps(dy[i]);
+
+        const __m256 wx = _mm256_sub_ps(px, _mm256_set1_ps(ax[i]));
+        const __m256 wy = _mm256_set1_ps(y - ay[i]);
+
+        __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(wx, sdx), _mm256_mul_ps(wy, sdy)), _mm256_set1_ps(invLen2[i]));
+        t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+
+        const __m256 ex = _mm256_sub_ps(wx, _mm256_mul_ps(t, sdx));
+        const __m256 ey = _mm256_sub_ps(wy, _mm256_mul_ps(t, sdy));
+        const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+
+        _mm256_store_ps(best, _mm256_min_ps(_mm256_load_ps(best), d2));
+    }
+
+    float farthest() const
+    {
+        const __m256 v = _mm256_load_ps(best);
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+
+#else
+
+    void add(uint32_t i, float x0, float y)
+    {
+        const float sax = ax[i];
+        const float sdx = dx[i];
+        const float sdy = dy[i];
+        const float inv = invLen2[i];
+        const float wy = y - ay[i];
+
+        for (int l = 0; l < LANES; ++l) {
+            const float wx = x0 + static_cast<float>(l) - sax;
+            float t = (wx * sdx + wy * sdy) * inv;
+            t = std::min(std::max(t, 0.f), 1.f);
+            const float ex = wx - t * sdx;
+            const float ey = wy - t * sdy;
+            best[l] = std::min(best[l], ex * ex + ey * ey);
+        }
+    }
+
+    float farthest() const
+    {
+        float m = best[0];
+        for (int l = 1; l < LANES; ++l) {
+            m = std::max(m, best[l]);
+        }
+        return m;
+    }
+
+#endif
+};
+}
+
+const char* SdfKernel::instructionSet()
+{
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+size_t SdfKernel::segmentsCount() const
+{
+    return m_ax.size();
+}
+
+int SdfKernel::channels() const
+{
+    return m_params.multiChannel ? 3 : 1;
+}
+
+void SdfKernel::addSegment(double x0, double y0, double x1, double y1)
+{
+    const double dx = x1 - x0;
+    const double dy = y1 - y0;
+    const double len2 = dx * dx + dy * dy;
+
+    m_ax.push_back(static_cast<float>(x0));
+    m_ay.push_back(static_cast<float>(y0));
+    m_dx.push_back(static_cast<float>(dx));
+    m_dy.push_back(static_cast<float>(dy));
+    m_invLen2.push_back(len2 > 0.0 ? static_cast<float>(1.0 / len2) : 0.f);
+
+    m_minX.push_back(static_cast<float>(std::min(x0, x1)));
+    m_minY.push_back(static_cast<float>(std::min(y0, y1)));
+    m_maxX.push_back(static_cast<float>(std::max(x0, x1)));
+    m_maxY.push_back(static_cast<float>(std::max(y0, y1)));
+
+    m_colors.push_back(WHITE);
+    m_flags.push_back(0);
+}
+
+//! NOTE The distance between a curve and its chords, with n uniform parts,
+//! is not more than max|B''| / (8 * n^2)
+static int flattenCount(double maxSecondDerivative, double tolerance)
+{
+    const double n = std::ceil(std::sqrt(maxSecondDerivative / (8.0 * tolerance)));
+    return std::clamp(static_cast<int>(n), 1, MAX_CURVE_SEGMENTS);
+}
+
+void SdfKernel::addQuadratic(const double* p, double tolerance)
+{
+    // B'' = 2 * (p0 - 2 * p1 + p2)
+    const double ddx = p[0] - 2 * p[2] + p[4];
+    const double ddy = p[1] - 2 * p[3] + p[5];
+    const int n = flattenCount(2.0 * std::hypot(ddx, ddy), tolerance);
+
+    double px = p[0];
+    double py = p[1];
+    for (int i = 1; i <= n; ++i) {
+        const double t = static_cast<double>(i) / n;
+        const double mt = 1.0 - t;
+        const double x = mt * mt * p[0] + 2 * mt * t * p[2] + t * t * p[4];
+        const double y = mt * mt * p[1] + 2 * mt * t * p[3] + t * t * p[5];
+        addSegment(px, py, x, y);
+        px = x;
+        py = y;
+    }
+}
+
+void SdfKernel::addCubic(const double* p, double tolerance)
+{
+    // max|B''| <= 6 * max(|p0 - 2 * p1 + p2|, |p1 - 2 * p2 + p3|)
+    const double d1 = std::hypot(p[0] - 2 * p[2] + p[4], p[1] - 2 * p[3] + p[5]);
+    const double d2 = std::hypot(p[2] - 2 * p[4] + p[6], p[3] - 2 * p[5] + p[7]);
+    const int n = flattenCount(6.0 * std::max(d1, d2), tolerance);
+
+    double px = p[0];
+    double py = p[1];
+    for (int i = 1; i <= n; ++i) {
+        const double t = static_cast<double>(i) / n;
+        const double mt = 1.0 - t;
+        const double a = mt * mt * mt;
+        const double b = 3 * mt * mt * t;
+        const double c = 3 * mt * t * t;
+        const double d = t * t * t;
+        const double x = a * p[0] + b * p[2] + c * p[4] + d * p[6];
+        const double y = a * p[1] + b * p[3] + c * p[5] + d * p[7];
+        addSegment(px, py, x, y);
+        px = x;
+        py = y;
+    }
+}
+
+void SdfKernel::prepare(const msdfgen::Shape& shape, const Params& params)
+{
+    m_params = params;
+    m_fillRule = static_cast<int>(shape.fillRule);
+    m_inverseYAxis = shape.inverseYAxis;
+
+    m_ax.clear();
+    m_ay.clear();
+    m_dx.clear();
+    m_dy.clear();
+    m_invLen2.clear();
+    m_minX.clear();
+    m_minY.clear();
+    m_maxX.clear();
+    m_maxY.clear();
+    m_colors.clear();
+    m_flags.clear();
+
+    //! NOTE Pixel space: the center of the pixel (x, y) is at (x, y)
+    auto toPixel = [&params](const msdfgen::Point2& sp, double* out) {
+        out[0] = (sp.x + params.translateX) * params.scale - 0.5;
+        out[1] = (sp.y + params.translateY) * params.scale - 0.5;
+    };
+
+    //! NOTE The seed of the edge coloring, fixed, so that the result is the same each time
+    uint64_t seed = 0;
+
+    double p[8];
+    std::vector<EdgeRange> edges;
+    for (const msdfgen::Contour& contour : shape.contours) {
+        edges.clear();
+        for (const msdfgen::EdgeSegment& edge : contour.edges) {
+            EdgeRange range;
+            range.first = m_ax.size();
+
+            using Type = msdfgen::EdgeSegment::ActualType;
+            switch (edge.actualType) {
+            case Type::Linear:
+                toPixel(edge.segments.linear.p[0], &p[0]);
+                toPixel(edge.segments.linear.p[1], &p[2]);
+                addSegment(p[0], p[1], p[2], p[3]);
+                break;
+            case Type::Quadratic:
+                for (int i = 0; i < 3; ++i) {
+                    toPixel(edge.segments.quadratic.p[i], &p[i * 2]);
+                }
+                addQuadratic(p, params.tolerance);
+                break;
+            case Type::Cubic:
+                for (int i = 0; i < 4; ++i) {
+                    toPixel(edge.segments.cubic.p[i], &p[i * 2]);
+                }
+                addCubic(p, params.tolerance);
+                break;
+            case Type::Undefined:
+                break;
+            }
+
+            range.last = m_ax.size();
+            if (range.first == range.last) {
+                continue;
+            }
+
+            const msdfgen::Vector2 d0 = edge.direction(0);
+            const msdfgen::Vector2 d1 = edge.direction(1);
+            range.dir0[0] = d0.x;
+            range.dir0[1] = d0.y;
+            range.dir1[0] = d1.x;
+            range.dir1[1] = d1.y;
+            edges.push_back(range);
+
+            m_flags[range.first] |= EDGE_START;
+            m_flags[range.last - 1] |= EDGE_END;
+        }
+
+        if (params.multiChannel) {
+            colorContour(edges, seed);
+        }
+    }
+}
+
+static bool isCorner(const double* a, const double* b, double crossThreshold)
+{
+    const double la = std::hypot(a[0], a[1]);
+    const double lb = std::hypot(b[0], b[1]);
+    if (la <= 0.0 || lb <= 0.0) {
+        return false;
+    }
+
+    const double dot = (a[0] * b[0] + a[1] * b[1]) / (la * lb);
+    const double cross = (a[0] * b[1] - a[1] * b[0]) / (la * lb);
+    return dot <= 0.0 || std::fabs(cross) > crossThreshold;
+}
+
+static void switchColor(uint8_t& color, uint64_t& seed, uint8_t banned = 0)
+{
+    const uint8_t combined = color & banned;
+    if (combined == RED || combined == GREEN || combined == BLUE) {
+        color = combined ^ WHITE;
+        return;
+    }
+
+    if (color == 0 || color == WHITE) {
+        static const uint8_t start[3] = { CYAN, MAGENTA, YELLOW };
+        color = start[seed % 3];
+        seed /= 3;
+        return;
+    }
+
+    const int shifted = color << (1 + (seed & 1));
+    color = static_cast<uint8_t>((shifted | shifted >> 3) & WHITE);
+    seed >>= 1;
+}
+
+//! NOTE As msdfgen's edgeColoringSimple
+void SdfKernel::colorContour(const std::vector<EdgeRange>& edges, uint64_t& seed)
+{
+    if (edges.empty()) {
+        return;
+    }
+
+    const double crossThreshold = std::sin(m_params.angleThreshold);
+
+    std::vector<size_t> corners;
+    const double* prevDir = edges.back().dir1;
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (isCorner(prevDir, edges[i].dir0, crossThreshold)) {
+            corners.push_back(i);
+        }
+        prevDir = edges[i].dir1;
+    }
+
+    // smooth contour, white is the default
+    if (corners.empty()) {
+        return;
+    }
+
+    // teardrop
+    if (corners.size() == 1) {
+        uint8_t colors[3] = { WHITE, WHITE, WHITE };
+        switchColor(colors[0], seed);
+        colors[2] = colors[0];
+        switchColor(colors[2], seed);
+        colorTeardrop(edges, corners.front(), colors);
+        return;
+    }
+
+    // multiple corners, the color is switched at each corner
+    const size_t cornerCount = corners.size();
+    const size_t m = edges.size();
+    const size_t start = corners.front();
+    size_t spline = 0;
+
+    uint8_t color = WHITE;
+    switchColor(color, seed);
+    const uint8_t initialColor = color;
+
+    for (size_t i = 0; i < m; ++i) {
+        const size_t index = (start + i) % m;
+        if (spline + 1 < cornerCount && corners[spline + 1] == index) {
+            ++spline;
+            switchColor(color, seed, spline == cornerCount - 1 ? initialColor : 0);
+        }
+
+        for (size_t s = edges[index].first; s < edges[index].last; ++s) {
+            m_colors[s] = color;
+        }
+    }
+}
+
+//! NOTE The contour is divided into three parts from the corner,
+//! msdfgen splits the edges in thirds if there are less than three of them,
+//! here the parts are made of the flattened segments
+void SdfKernel::colorTeardrop(const std::vector<EdgeRange>& edges, size_t corner, const uint8_t* colors)
+{
+    const size_t m = edges.size();
+    if (m >= 3) {
+        for (size_t i = 0; i < m; ++i) {
+            const int part = static_cast<int>(3 + 2.875 * i / (m - 1) - 1.4375 + .5) - 3;
+            const uint8_t color = colors[1 + part];
+            const EdgeRange& e = edges[(corner + i) % m];
+            for (size_t s = e.first; s < e.last; ++s) {
+                m_colors[s] = color;
+            }
+        }
+        return;
+    }
+
+    const size_t first = edges.front().first;
+    const size_t count = edges.back().last - first;
+    if (count < 3) {
+        return;
+    }
+
+    const size_t startSeg = edges[corner].first - first;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t s = first + (startSeg + i) % count;
+        const size_t part = i * 3 / count;
+        m_colors[s] = colors[part];
+
+        // the parts are the edges now
+        if (i == 0 || part != (i - 1) * 3 / count) {
+            m_flags[s] |= EDGE_START;
+        }
+        if (i == count - 1 || part != (i + 1) * 3 / count) {
+            m_flags[s] |= EDGE_END;
+        }
+    }
+}
+
+//! NOTE The same rule as msdfgen's WindingSpanner: a ray to +X,
+//! a segment crosses the row if minY <= y < maxY
+void SdfKernel::rowCrossings(float y, std::vector<std::pair<float, int> >& crossings) const
+{
+    crossings.clear();
+
+    const size_t count = m_ax.size();
+    for (size_t i = 0; i < count; ++i) {
+        if (y < m_minY[i] || y >= m_maxY[i]) {
+            continue;
+        }
+
+        const float x = m_ax[i] + (y - m_ay[i]) * m_dx[i] / m_dy[i];
+        crossings.emplace_back(x, m_dy[i] > 0.f ? 1 : -1);
+    }
+
+    std::sort(crossings.begin(), crossings.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) {
+        return a.first < b.first;
+    });
+}
+
+void SdfKernel::rowCandidates(float y, std::vector<uint32_t>& candidates) const
+{
+    candidates.clear();
+
+    const float limit = static_cast<float>(0.5 * m_params.range * m_params.scale);
+    const size_t count = m_ax.size();
+    for (size_t i = 0; i < count; ++i) {
+        if (y > m_minY[i] - limit && y < m_maxY[i] + limit) {
+            candidates.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+void SdfKernel::generate(uint8_t* bitmap, int width, int height) const
+{
+    if (m_params.multiChannel) {
+        generateMulti(bitmap, width, height);
+    } else {
+        generateSingle(bitmap, width, height);
+    }
+}
+
+static inline int windingSign(int fillRule, int winding, const std::vector<std::pair<float, int> >& crossings, size_t span)
+{
+    switch (fillRule) {
+    case msdfgen::FillRule::NonZero:
+        return winding != 0 ? 1 : -1;
+    case msdfgen::FillRule::EvenOdd:
+        return winding % 2 == 0 ? 1 : -1;
+    default:
+        return span < crossings.size() ? crossings[span].second : 0;
+    }
+}
+
+static inline uint8_t distanceToByte(double distance, double pxRangeRev)
+{
+    const double v = (distance * pxRangeRev + 0.5) * 0x100;
+    return static_cast<uint8_t>(std::clamp(v, 0.0, 255.0));
+}
+
+void SdfKernel::generateSingle(uint8_t* bitmap, int width, int height) const
+{
+    const double pxRange = m_params.range * m_params.scale;
+    const double pxRangeRev = pxRange > 0.0 ? 1.0 / pxRange : 0.0;
+
+    //! NOTE Farther than the half of the range, the output is clamped (0 or 255),
+    //! so the distance is not needed
+    const float limit = static_cast<float>(0.5 * pxRange);
+    const float limit2 = limit * limit * 1.0001f;
+
+    thread_local std::vector<std::pair<float, int> > crossings;
+    thread_local std::vector<uint32_t> candidates;
+
+    Block block;
+    block.ax = m_ax.data();
+    block.ay = m_ay.data();
+    block.dx = m_dx.data();
+    block.dy = m_dy.data();
+    block.invLen2 = m_invLen2.data();
+
+    for (int y = 0; y < height; ++y) {
+        const float fy = static_cast<float>(y);
+        uint8_t* row = bitmap + size_t(m_inverseYAxis ? height - y - 1 : y) * width;
+
+        rowCrossings(fy, crossings);
+        rowCandidates(fy, candidates);
+
+        // winding walk
+        int winding = m_fillRule == msdfgen::FillRule::EvenOdd ? 1 : 0;
+        size_t span = 0;
+
+        //! NOTE The nearest segment of the previous block is likely the nearest one of this block,
+        //! it is processed first, so that the others are skipped earlier
+        uint32_t seed = UINT32_MAX;
+
+        for (int x0 = 0; x0 < width; x0 += LANES) {
+            const float bx0 = static_cast<float>(x0);
+            const float bx1 = static_cast<float>(x0 + LANES - 1);
+
+            block.init(limit2);
+            float farthest = limit2;
+
+            if (seed != UINT32_MAX) {
+                block.add(seed, bx0, fy);
+                farthest = block.farthest();
+            }
+
+            for (uint32_t i : candidates) {
+                const float gx = std::max(std::max(m_minX[i] - bx1, bx0 - m_maxX[i]), 0.f);
+                const float gy = std::max(std::max(m_minY[i] - fy, fy - m_maxY[i]), 0.f);
+                if (gx * gx + gy * gy >= farthest) {
+                    continue;
+                }
+
+                block.add(i, bx0, fy);
+                const float f = block.farthest();
+                if (f < farthest) {
+                    farthest = f;
+                    seed = i;
+                }
+            }
+
+            const int x1 = std::min(x0 + LANES, width);
+            for (int x = x0; x < x1; ++x) {
+                const float fx = static_cast<float>(x);
+                while (span < crossings.size() && fx > crossings[span].first) {
+                    winding += crossings[span].second;
+                    ++span;
+                }
+
+                const int sign = windingSign(m_fillRule, winding, crossings, span);
+                const double distance = sign * std::sqrt(static_cast<double>(block.best[x - x0]));
+                row[x] = distanceToByte(distance, pxRangeRev);
+            }
+        }
+    }
+}
+
+static inline float median(float a, float b, float c)
+{
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+//! NOTE As msdfgen's pixelClash: the neighbour pixels, both inside or both outside,
+//! with two channels changed from inside to outside (an artifact between the texels)
+static bool pixelClash(const float* a, const float* b, float threshold)
+{
+    const bool aIn = (a[0] > .5f) + (a[1] > .5f) + (a[2] > .5f) >= 2;
+    const bool bIn = (b[0] > .5f) + (b[1] > .5f) + (b[2] > .5f) >= 2;
+    if (aIn != bIn) {
+        return false;
+    }
+
+    // if the change is 0 <-> 1 or 2 <-> 3 channels and not 1 <-> 1 or 2 <-> 2, it is not a clash
+    if ((a[0] > .5f && a[1] > .5f && a[2] > .5f) || (a[0] < .5f && a[1] < .5f && a[2] < .5f)
+        || (b[0] > .5f && b[1] > .5f && b[2] > .5f) || (b[0] < .5f && b[1] < .5f && b[2] < .5f)) {
+        return false;
+    }
+
+    auto changed = [a, b](int c) {
+        return (a[c] > .5f) != (b[c] > .5f) && (a[c] < .5f) != (b[c] < .5f);
+    };
+
+    // the changing channels and the remaining one
+    int ca = -1, cb = -1, cc = -1;
+    if (changed(0)) {
+        ca = 0;
+        if (changed(1)) {
+            cb = 1;
+            cc = 2;
+        } else if (changed(2)) {
+            cb = 2;
+            cc = 1;
+        } else {
+            return false;
+        }
+    } else if (changed(1) && changed(2)) {
+        ca = 1;
+        cb = 2;
+        cc = 0;
+    } else {
+        return false;
+    }
+
+    // only the pixel farther from the edge is flagged
+    return std::fabs(a[ca] - b[ca]) >= threshold
+           && std::fabs(a[cb] - b[cb]) >= threshold
+           && std::fabs(a[cc] - .5f) >= std::fabs(b[cc] - .5f);
+}
+
+static void msdfErrorCorrection(float* values, int width, int height, float threshold)
+{
+    thread_local std::vector<size_t> clashes;
+    clashes.clear();
+
+    auto at = [values, width](int x, int y) {
+        return values + (size_t(y) * width + x) * 3;
+    };
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float* p = at(x, y);
+            if ((x > 0 && pixelClash(p, at(x - 1, y), threshold))
+                || (x < width - 1 && pixelClash(p, at(x + 1, y), threshold))
+                || (y > 0 && pixelClash(p, at(x, y - 1), threshold))
+                || (y < height - 1 && pixelClash(p, at(x, y + 1), threshold))) {
+                clashes.push_back(size_t(y) * width + x);
+            }
+        }
+    }
+
+    for (size_t i : clashes) {
+        float* p = values + i * 3;
+        const float m = median(p[0], p[1], p[2]);
+        p[0] = p[1] = p[2] = m;
+    }
+}
+
+void SdfKernel::generateMulti(uint8_t* bitmap, int width, int height) const
+{
+    const double pxRange = m_params.range * m_params.scale;
+    const double pxRangeRev = pxRange > 0.0 ? 1.0 / pxRange : 0.0;
+
+    const float limit = static_cast<float>(0.5 * pxRange);
+    const float limit2 = limit * limit * 1.0001f;
+
+    //! NOTE Relative difference of the distances that are considered equal
+    //! (the edges joined at a corner), then the edge the pixel is more perpendicular to is taken
+    const float TIE = 1e-4f;
+
+    struct Channel {
+        float d2 = 0.f;
+        float dot = 0.f;
+        uint32_t seg = NO_SEGMENT;
+    };
+
+    thread_local std::vector<std::pair<float, int> > crossings;
+    thread_local std::vector<uint32_t> candidates;
+
+    // normalized distances (distance / range + 0.5), for the error correction
+    thread_local std::vector<float> values;
+    values.resize(size_t(width) * height * 3);
+
+    for (int y = 0; y < height; ++y) {
+        const float fy = static_cast<float>(y);
+        float* row = values.data() + size_t(m_inverseYAxis ? height - y - 1 : y) * width * 3;
+
+        rowCrossings(fy, crossings);
+        rowCandidates(fy, candidates);
+
+        int winding = m_fillRule == msdfgen::FillRule::EvenOdd ? 1 : 0;
+        size_t span = 0;
+
+        for (int x = 0; x < width; ++x) {
+            const float fx = static_cast<float>(x);
+
+            Channel ch[3];
+            for (Channel& c : ch) {
+                c.d2 = limit2;
+            }
+            float farthest = limit2;
+
+            for (uint32_t i : candidates) {
+                const float gx = std::max(std::max(m_minX[i] - fx, fx - m_maxX[i]), 0.f);
+                const float gy = std::max(std::max(m_minY[i] - fy, fy - m_maxY[i]), 0.f);
+                if (gx * gx + gy * gy > farthest * (1.f + TIE)) {
+                    continue;
+                }
+
+                const float wx = fx - m_ax[i];
+                const float wy = fy - m_ay[i];
+                const float t = (wx * m_dx[i] + wy * m_dy[i]) * m_invLen2[i];
+                const float tc = std::min(std::max(t, 0.f), 1.f);
+                const float ex = wx - tc * m_dx[i];
+                const float ey = wy - tc * m_dy[i];
+                const float d2 = ex * ex + ey * ey;
+
+                // alignment at the ends, as msdfgen's SignedDistance::dot
+                float dot = 0.f;
+                if (t <= 0.f || t >= 1.f) {
+                    const float l = std::sqrt(d2 * (m_dx[i] * m_dx[i] + m_dy[i] * m_dy[i]));
+                    dot = l > 0.f ? std::fabs(ex * m_dx[i] + ey * m_dy[i]) / l : 0.f;
+                }
+
+                const uint8_t colors = m_colors[i];
+                for (int c = 0; c < 3; ++c) {
+                    if (!(colors & (1 << c))) {
+                        continue;
+                    }
+
+                    Channel& b = ch[c];
+                    const float tie = b.d2 * TIE;
+                    if (d2 < b.d2 - tie || (d2 <= b.d2 + tie && b.seg != NO_SEGMENT && dot < b.dot)) {
+                        b.d2 = d2;
+                        b.dot = dot;
+                        b.seg = i;
+                    }
+                }
+
+                farthest = std::max(std::max(ch[0].d2, ch[1].d2), ch[2].d2);
+            }
+
+            // signed pseudo-distance to the nearest edge of the channel
+            double dist[3];
+            for (int c = 0; c < 3; ++c) {
+                const uint32_t i = ch[c].seg;
+                if (i == NO_SEGMENT) {
+                    dist[c] = limit;
+                    continue;
+                }
+
+                const double wx = fx - m_ax[i];
+                const double wy = fy - m_ay[i];
+                const double t = (wx * m_dx[i] + wy * m_dy[i]) * m_invLen2[i];
+                const double cross = m_dx[i] * wy - m_dy[i] * wx;
+
+                if ((t < 0.0 && (m_flags[i] & EDGE_START)) || (t > 1.0 && (m_flags[i] & EDGE_END))) {
+                    // beyond the end of the edge, the distance to its line
+                    dist[c] = cross * std::sqrt(static_cast<double>(m_invLen2[i]));
+                } else {
+                    dist[c] = (cross >= 0.0 ? 1.0 : -1.0) * std::sqrt(static_cast<double>(ch[c].d2));
+                }
+            }
+
+            while (span < crossings.size() && fx > crossings[span].first) {
+                winding += crossings[span].second;
+                ++span;
+            }
+
+            //! NOTE The sign of the edges can be wrong (overlapping contours, the orientation of the contours),
+            //! the median must have the sign of the winding
+            const int sign = windingSign(m_fillRule, winding, crossings, span);
+            for (int c = 0; c < 3; ++c) {
+                if (ch[c].seg == NO_SEGMENT) {
+                    dist[c] = sign * limit;
+                }
+            }
+
+            const double med = std::max(std::min(dist[0], dist[1]), std::min(std::max(dist[0], dist[1]), dist[2]));
+            if (sign != 0 && (med > 0.0) != (sign > 0)) {
+                for (double& d : dist) {
+                    d = -d;
+                }
+            }
+
+            float* px = row + size_t(x) * 3;
+            for (int c = 0; c < 3; ++c) {
+                px[c] = static_cast<float>(dist[c] * pxRangeRev + 0.5);
+            }
+        }
+    }
+
+    //! NOTE As msdfgen's generateMSDF, the edge threshold is 1 pixel
+    msdfErrorCorrection(values.data(), width, height, static_cast<float>(1.00000001 * pxRangeRev));
+
+    const size_t size = values.size();
+    for (size_t i = 0; i < size; ++i) {
+        bitmap[i] = static_cast<uint8_t>(std::clamp(values[i] * 256.f, 0.f, 255.f));
+    }
+}
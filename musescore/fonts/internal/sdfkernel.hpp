@@ -0,0 +1,102 @@
+#ifndef XTZ_FONTS_SDFKERNEL_H
+#define XTZ_FONTS_SDFKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace msdfgen {
+class Shape;
+}
+
+namespace xtz::fonts {
+//! NOTE Single channel SDF generator, the replacement of msdfgen::generateSDF.
+//! The output is the same (within the flatten tolerance):
+//! (distance / range + 0.5) * 256 clamped, positive inside, the same sign rule.
+//!
+//! The shape is prepared once per glyph: the curves are flattened into line segments,
+//! transformed into the pixel space and stored as SoA float arrays.
+//! The distance is computed for a block of pixels of a row at once
+//! (16 with AVX-512, 8 with AVX2 and in the scalar fallback), the segments
+//! whose bbox is farther than the current farthest distance of the block are skipped.
+//! The distance is limited by the range, as beyond it the output is clamped anyway,
+//! so most of the segments are skipped.
+//!
+//! Multi-channel mode (MSDF): the edges are colored (as msdfgen's edgeColoringSimple),
+//! each of the 3 channels (RGB) is the signed pseudo-distance to the nearest edge of its color,
+//! the shape is reconstructed by the median of the channels, so the corners remain sharp
+//! at a much smaller bitmap. The sign of each pixel is corrected by the winding,
+//! so overlapping contours are handled as in the single channel mode.
+class SdfKernel
+{
+public:
+    SdfKernel() = default;
+
+    struct Params {
+        double range = 0.0;         // shape units, as for msdfgen::generateSDF
+        double scale = 1.0;         // pixels per shape unit
+        double translateX = 0.0;    // shape units
+        double translateY = 0.0;
+        double tolerance = 1.0 / 32; // flatten tolerance, pixels
+        bool multiChannel = false;
+        double angleThreshold = 3.0; // radians, the edges joined at a smaller angle form a corner
+    };
+
+    //! NOTE All contours of the shape are used, mergeContours is not needed
+    void prepare(const msdfgen::Shape& shape, const Params& params);
+
+    //! NOTE The bitmap must have width * height * channels() bytes,
+    //! multi-channel pixels are RGB
+    void generate(uint8_t* bitmap, int width, int height) const;
+
+    int channels() const;
+
+    size_t segmentsCount() const;
+
+    //! NOTE For the log
+    static const char* instructionSet();
+
+private:
+
+    struct EdgeRange {
+        size_t first = 0;   // segments
+        size_t last = 0;
+        double dir0[2];     // direction at the start
+        double dir1[2];     // direction at the end
+    };
+
+    void addSegment(double x0, double y0, double x1, double y1);
+    void addQuadratic(const double* p, double tolerance);
+    void addCubic(const double* p, double tolerance);
+
+    void colorContour(const std::vector<EdgeRange>& edges, uint64_t& seed);
+    void colorTeardrop(const std::vector<EdgeRange>& edges, size_t corner, const uint8_t* colors);
+
+    void generateSingle(uint8_t* bitmap, int width, int height) const;
+    void generateMulti(uint8_t* bitmap, int width, int height) const;
+
+    void rowCrossings(float y, std::vector<std::pair<float, int> >& crossings) const;
+    void rowCandidates(float y, std::vector<uint32_t>& candidates) const;
+
+    // segments in pixel space, a + t * d
+    std::vector<float> m_ax;
+    std::vector<float> m_ay;
+    std::vector<float> m_dx;
+    std::vector<float> m_dy;
+    std::vector<float> m_invLen2;   // 0 for degenerate
+    // segments bbox
+    std::vector<float> m_minX;
+    std::vector<float> m_minY;
+    std::vector<float> m_maxX;
+    std::vector<float> m_maxY;
+    // multi-channel
+    std::vector<uint8_t> m_colors;  // channels mask
+    std::vector<uint8_t> m_flags;   // the first / the last segment of an edge
+
+    Params m_params;
+    int m_fillRule = 0;
+    bool m_inverseYAxis = false;
+};
+}
+
+#endif // XTZ_FONTS_SDFKERNEL_H
@@ -0,0 +1,580 @@
+#include "sdfpackfile.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <unordered_set>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "log.h"
+
+using namespace xtz::fonts;
+
+static const char FILE_MAGIC[4] = { 'X', 'S', 'D', 'P' };
+static const uint32_t FILE_VERSION = 2;
+static const uint32_t RECORD_MAGIC = 0x52445358; // XSDR
+
+//! NOTE The grown part of the file smaller than this is read, not mapped
+static const size_t MIN_MAP_SIZE = 256 * 1024;
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version = 0;
+};
+
+struct RecordHeader {
+    uint32_t magic = RECORD_MAGIC;
+    uint32_t checksum = 0;  // of the header (with 0 checksum), the key and the data
+    uint32_t keySize = 0;
+    uint32_t dataSize = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t format = 0;    // SdfFormat | channels << 8
+    float rect[4] = { 0.f, 0.f, 0.f, 0.f };
+};
+
+static_assert(sizeof(FileHeader) == 8, "unexpected file header size");
+static_assert(sizeof(RecordHeader) == 44, "unexpected record header size");
+
+// FNV-1a
+static uint32_t checksum(uint32_t h, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t recordChecksum(RecordHeader h, const uint8_t* key, const uint8_t* data)
+{
+    h.checksum = 0;
+    uint32_t c = 2166136261u;
+    c = checksum(c, reinterpret_cast<const uint8_t*>(&h), sizeof(h));
+    c = checksum(c, key, h.keySize);
+    c = checksum(c, data, h.dataSize);
+    return c;
+}
+
+//! NOTE data is the file from dataPos (offsets are of the file),
+//! returns the end of the record at the offset, or 0 if there is no valid record
+static size_t readRecord(const uint8_t* data, size_t dataPos, size_t size, size_t offset, RecordHeader& h)
+{
+    if (offset + sizeof(RecordHeader) > size) {
+        return 0;
+    }
+
+    std::memcpy(&h, data + (offset - dataPos), sizeof(h));
+    if (h.magic != RECORD_MAGIC) {
+        return 0;
+    }
+
+    const size_t end = offset + sizeof(h) + size_t(h.keySize) + size_t(h.dataSize);
+    if (end > size) {
+        return 0;
+    }
+
+    const uint8_t* key = data + (offset - dataPos) + sizeof(h);
+    if (recordChecksum(h, key, key + h.keySize) != h.checksum) {
+        return 0;
+    }
+
+    return end;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+namespace {
+struct FileLock {
+    int fd = -1;
+    explicit FileLock(int f)
+        : fd(f) { ::flock(fd, LOCK_EX); }
+    ~FileLock() { ::flock(fd, LOCK_UN); }
+};
+}
+
+SdfPackFile::~SdfPackFile()
+{
+    close();
+}
+
+mu::ByteArray SdfPackFile::makeHeader()
+{
+    FileHeader h;
+    std::memcpy(h.magic, FILE_MAGIC, sizeof(h.magic));
+    h.version = FILE_VERSION;
+    return mu::ByteArray(reinterpret_cast<const uint8_t*>(&h), sizeof(h));
+}
+
+mu::ByteArray SdfPackFile::makeRecord(const std::string& key, const GlyphImage& image)
+{
+    RecordHeader h;
+    h.keySize = static_cast<uint32_t>(key.size());
+    h.dataSize = static_cast<uint32_t>(image.sdf.bitmap.size());
+    h.width = image.sdf.width;
+    h.height = image.sdf.height;
+    h.format = static_cast<uint32_t>(image.sdf.format) | (uint32_t(image.sdf.channels) << 8);
+    h.rect[0] = static_cast<float>(image.rect.x());
+    h.rect[1] = static_cast<float>(image.rect.y());
+    h.rect[2] = static_cast<float>(image.rect.width());
+    h.rect[3] = static_cast<float>(image.rect.height());
+    h.checksum = recordChecksum(h, reinterpret_cast<const uint8_t*>(key.data()), image.sdf.bitmap.constData());
+
+    mu::ByteArray rec;
+    rec.resize(sizeof(h) + h.keySize + h.dataSize);
+    uint8_t* p = rec.data();
+    std::memcpy(p, &h, sizeof(h));
+    std::memcpy(p + sizeof(h), key.data(), h.keySize);
+    if (h.dataSize > 0) {
+        std::memcpy(p + sizeof(h) + h.keySize, image.sdf.bitmap.constData(), h.dataSize);
+    }
+    return rec;
+}
+
+static bool isValidHeader(const uint8_t* data, size_t size)
+{
+    if (size < sizeof(FileHeader)) {
+        return false;
+    }
+
+    FileHeader h;
+    std::memcpy(&h, data, sizeof(h));
+    return std::memcmp(h.magic, FILE_MAGIC, sizeof(h.magic)) == 0 && h.version == FILE_VERSION;
+}
+
+//! NOTE A file with the header only is written next to the path and renamed over it,
+//! so the processes that still have the old file mapped keep their data
+static bool replaceWithEmpty(const std::string& path)
+{
+    std::string tmpPath = path + ".XXXXXX";
+    int fd = ::mkstemp(tmpPath.data());
+    if (fd < 0) {
+        return false;
+    }
+
+    mu::ByteArray header = SdfPackFile::makeHeader();
+    bool ok = ::fchmod(fd, 0644) == 0 && writeAll(fd, header.constData(), header.size());
+    ::close(fd);
+
+    ok = ok && ::rename(tmpPath.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        ::unlink(tmpPath.c_str());
+    }
+    return ok;
+}
+
+bool SdfPackFile::open(const mu::io::path_t& path)
+{
+    close();
+
+    const std::string filePath = path.toStdString();
+
+    //! NOTE The file can be replaced (by us or other process) while we are waiting for the lock,
+    //! then it is opened again
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        m_fd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            LOGE() << "failed open sdf pack: " << path << ", err: " << std::strerror(errno);
+            return false;
+        }
+
+        bool replaced = false;
+        {
+            FileLock lock(m_fd);
+
+            struct stat st = {};
+            struct stat pathSt = {};
+            if (::fstat(m_fd, &st) != 0) {
+                LOGE() << "failed stat sdf pack: " << path;
+                close();
+                return false;
+            }
+
+            if (::stat(filePath.c_str(), &pathSt) != 0 || pathSt.st_dev != st.st_dev || pathSt.st_ino != st.st_ino) {
+                replaced = true;
+            } else {
+                // check header, the file of other version (or broken) is started again
+                bool isValid = false;
+                if (static_cast<size_t>(st.st_size) >= sizeof(FileHeader)) {
+                    uint8_t buf[sizeof(FileHeader)];
+                    isValid = ::pread(m_fd, buf, sizeof(buf), 0) == static_cast<ssize_t>(sizeof(buf))
+                              && isValidHeader(buf, sizeof(buf));
+                }
+
+                if (isValid) {
+                    m_fileEnd = sizeof(FileHeader);
+                    return refresh(true);
+                }
+
+                //! NOTE An empty file has no records, so nobody has them mapped,
+                //! the header is written in place
+                if (st.st_size == 0) {
+                    mu::ByteArray header = makeHeader();
+                    if (!writeAll(m_fd, header.constData(), header.size())) {
+                        LOGE() << "failed write sdf pack: " << path;
+                        close();
+                        return false;
+                    }
+
+                    m_fileEnd = sizeof(FileHeader);
+                    return refresh(true);
+                }
+
+                //! NOTE Not truncated, other processes may have the records mapped
+                LOGW() << "sdf pack has not expected header, it will be replaced: " << path;
+                if (!replaceWithEmpty(filePath)) {
+                    LOGE() << "failed replace sdf pack: " << path << ", err: " << std::strerror(errno);
+                    close();
+                    return false;
+                }
+                replaced = true;
+            }
+        }
+
+        if (replaced) {
+            close();
+        }
+    }
+
+    LOGE() << "failed open sdf pack, it is replaced all the time: " << path;
+    return false;
+}
+
+bool SdfPackFile::compact(const mu::io::path_t& path, size_t maxSize, const std::function<bool(std::string_view key)>& isLive)
+{
+    const std::string filePath = path.toStdString();
+
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        // nothing to compact
+        return errno == ENOENT;
+    }
+
+    struct Range {
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    bool ok = true;
+    {
+        FileLock lock(fd);
+
+        struct stat st = {};
+        struct stat pathSt = {};
+        const bool isActual = ::fstat(fd, &st) == 0 && ::stat(filePath.c_str(), &pathSt) == 0
+                              && pathSt.st_dev == st.st_dev && pathSt.st_ino == st.st_ino;
+
+        // replaced by other process (just compacted), or the header will be written by open
+        const size_t size = static_cast<size_t>(st.st_size);
+        void* p = MAP_FAILED;
+        if (isActual && size > sizeof(FileHeader)) {
+            p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+
+        const uint8_t* data = p != MAP_FAILED ? static_cast<const uint8_t*>(p) : nullptr;
+        if (data && isValidHeader(data, size)) {
+            //! NOTE The first record of a key is used (see scan), so the later ones are dropped
+            std::vector<Range> live;
+            std::unordered_set<std::string_view> keys;
+            size_t liveSize = 0;
+            size_t offset = sizeof(FileHeader);
+            RecordHeader h;
+            while (size_t end = readRecord(data, 0, size, offset, h)) {
+                const std::string_view key(reinterpret_cast<const char*>(data + offset + sizeof(h)), h.keySize);
+                if (isLive(key) && keys.insert(key).second) {
+                    live.push_back({ offset, end });
+                    liveSize += end - offset;
+                }
+                offset = end;
+            }
+
+            //! NOTE The records are in the order of appending, so the oldest ones are dropped
+            size_t first = 0;
+            if (liveSize > maxSize) {
+                while (first < live.size() && liveSize > maxSize / 2) {
+                    liveSize -= live[first].end - live[first].begin;
+                    ++first;
+                }
+            }
+
+            const size_t newSize = sizeof(FileHeader) + liveSize;
+            if (newSize < size) {
+                std::string tmpPath = filePath + ".XXXXXX";
+                int tmpFd = ::mkstemp(tmpPath.data());
+                ok = tmpFd >= 0;
+                if (ok) {
+                    mu::ByteArray header = makeHeader();
+                    ok = ::fchmod(tmpFd, 0644) == 0 && writeAll(tmpFd, header.constData(), header.size());
+
+                    // the adjacent records are written at once
+                    for (size_t i = first; ok && i < live.size();) {
+                        size_t j = i + 1;
+                        while (j < live.size() && live[j].begin == live[j - 1].end) {
+                            ++j;
+                        }
+                        ok = writeAll(tmpFd, data + live[i].begin, live[j - 1].end - live[i].begin);
+                        i = j;
+                    }
+                    ::close(tmpFd);
+
+                    //! NOTE Renamed under the lock of the old file, so other process does not append to it meanwhile
+                    ok = ok && ::rename(tmpPath.c_str(), filePath.c_str()) == 0;
+                    if (!ok) {
+                        ::unlink(tmpPath.c_str());
+                    }
+                }
+
+                if (ok) {
+                    LOGI() << "sdf pack compacted: " << size << " -> " << newSize << " bytes, records: " << (live.size() - first);
+                } else {
+                    LOGE() << "failed compact sdf pack: " << path << ", err: " << std::strerror(errno);
+                }
+            }
+        }
+
+        if (data) {
+            ::munmap(p, size);
+        }
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+bool SdfPackFile::openData(const mu::ByteArray& data)
+{
+    close();
+
+    if (!isValidHeader(data.constData(), data.size())) {
+        LOGE() << "sdf pack data has not expected header";
+        return false;
+    }
+
+    m_data = data;
+    m_fileEnd = scan(m_data.constData(), 0, m_data.size(), sizeof(FileHeader));
+    return true;
+}
+
+void SdfPackFile::close()
+{
+    m_index.clear();
+    m_dataSize = 0;
+
+    for (const Mapping& m : m_mappings) {
+        ::munmap(const_cast<uint8_t*>(m.data), m.size);
+    }
+    m_mappings.clear();
+    m_chunks.clear();
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_data = mu::ByteArray();
+    m_fileEnd = 0;
+}
+
+bool SdfPackFile::isOpened() const
+{
+    return m_fd >= 0 || !m_data.empty();
+}
+
+size_t SdfPackFile::count() const
+{
+    return m_index.size();
+}
+
+size_t SdfPackFile::dataSize() const
+{
+    return m_dataSize;
+}
+
+size_t SdfPackFile::scan(const uint8_t* data, size_t dataPos, size_t size, size_t offset)
+{
+    RecordHeader h;
+    while (size_t end = readRecord(data, dataPos, size, offset, h)) {
+        const uint8_t* key = data + (offset - dataPos) + sizeof(h);
+        const uint8_t* bitmap = key + h.keySize;
+
+        Record r;
+        r.width = h.width;
+        r.height = h.height;
+        r.format = static_cast<SdfFormat>(h.format & 0xFF);
+        r.channels = static_cast<uint8_t>((h.format >> 8) & 0xFF);
+        r.rect = mu::RectF(h.rect[0], h.rect[1], h.rect[2], h.rect[3]);
+        r.data = bitmap;
+        r.dataSize = h.dataSize;
+
+        //! NOTE Several processes can append the same glyph, the first one is used
+        if (m_index.emplace(std::string(reinterpret_cast<const char*>(key), h.keySize), r).second) {
+            m_dataSize += r.dataSize;
+        }
+
+        offset = end;
+    }
+
+    return offset;
+}
+
+bool SdfPackFile::refresh(bool repair)
+{
+    if (m_fd < 0) {
+        return false;
+    }
+
+    struct stat st = {};
+    if (::fstat(m_fd, &st) != 0) {
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size <= m_fileEnd) {
+        return true;
+    }
+
+    size_t end = m_fileEnd;
+    if (size - m_fileEnd < MIN_MAP_SIZE) {
+        mu::ByteArray& chunk = m_chunks.emplace_back();
+        chunk.resize(size - m_fileEnd);
+        if (::pread(m_fd, chunk.data(), chunk.size(), static_cast<off_t>(m_fileEnd)) != static_cast<ssize_t>(chunk.size())) {
+            LOGE() << "failed read sdf pack, err: " << std::strerror(errno);
+            m_chunks.pop_back();
+            return false;
+        }
+
+        end = scan(chunk.constData(), m_fileEnd, size, m_fileEnd);
+
+        //! NOTE No records - no views into the chunk (a record is being written by other process)
+        if (end == m_fileEnd) {
+            m_chunks.pop_back();
+        }
+    } else {
+        //! NOTE The records before the end are in the previous mappings,
+        //! the mapping offset must be a multiple of the page size
+        static const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const size_t mapPos = m_fileEnd - m_fileEnd % pageSize;
+
+        void* p = ::mmap(nullptr, size - mapPos, PROT_READ, MAP_SHARED, m_fd, static_cast<off_t>(mapPos));
+        if (p == MAP_FAILED) {
+            LOGE() << "failed map sdf pack, err: " << std::strerror(errno);
+            return false;
+        }
+
+        Mapping m;
+        m.data = static_cast<const uint8_t*>(p);
+        m.size = size - mapPos;
+
+        end = scan(m.data, mapPos, size, m_fileEnd);
+
+        if (end != m_fileEnd) {
+            m_mappings.push_back(m);
+        } else {
+            ::munmap(p, m.size);
+        }
+    }
+    m_fileEnd = end;
+
+    //! NOTE Without the lock, the rest may be a record that is being written right now,
+    //! with the lock, it is a record torn by a crash
+    if (end < size && repair) {
+        LOGW() << "sdf pack has torn record, cut off " << (size - end) << " bytes";
+        if (::ftruncate(m_fd, static_cast<off_t>(end)) != 0) {
+            LOGE() << "failed truncate sdf pack, err: " << std::strerror(errno);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SdfPackFile::find(const std::string& key, GlyphImage& image)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        // may be appended by other process
+        refresh(false);
+        it = m_index.find(key);
+        if (it == m_index.end()) {
+            return false;
+        }
+    }
+
+    const Record& r = it->second;
+    if (r.data) {
+        image.sdf.bitmap = mu::ByteArray::fromRawData(r.data, r.dataSize);
+    } else {
+        mu::ByteArray bitmap;
+        bitmap.resize(r.dataSize);
+        if (::pread(m_fd, bitmap.data(), r.dataSize, static_cast<off_t>(r.dataOffset)) != static_cast<ssize_t>(r.dataSize)) {
+            LOGE() << "failed read sdf pack, err: " << std::strerror(errno);
+            return false;
+        }
+        image.sdf.bitmap = bitmap;
+    }
+    image.sdf.width = r.width;
+    image.sdf.height = r.height;
+    image.sdf.format = r.format;
+    image.sdf.channels = r.channels;
+    image.rect = r.rect;
+    return true;
+}
+
+bool SdfPackFile::append(const std::string& key, const GlyphImage& image)
+{
+    IF_ASSERT_FAILED(m_fd >= 0) {
+        return false;
+    }
+
+    mu::ByteArray rec = makeRecord(key, image);
+
+    FileLock lock(m_fd);
+
+    // index what other processes appended and cut off a torn record, so the new one follows a valid one
+    if (!refresh(true)) {
+        return false;
+    }
+
+    if (!writeAll(m_fd, rec.constData(), rec.size())) {
+        LOGE() << "failed write sdf pack, err: " << std::strerror(errno);
+        return false;
+    }
+
+    //! NOTE The own record is not mapped (the owner has the image in memory),
+    //! it is indexed by the offset, to be read if the owner has evicted the image
+    Record r;
+    r.width = image.sdf.width;
+    r.height = image.sdf.height;
+    r.format = image.sdf.format;
+    r.channels = image.sdf.channels;
+    //! NOTE As read from the file
+    r.rect = mu::RectF(static_cast<float>(image.rect.x()), static_cast<float>(image.rect.y()),
+                       static_cast<float>(image.rect.width()), static_cast<float>(image.rect.height()));
+    r.dataSize = image.sdf.bitmap.size();
+    r.dataOffset = m_fileEnd + sizeof(RecordHeader) + key.size();
+    if (m_index.emplace(key, r).second) {
+        m_dataSize += r.dataSize;
+    }
+
+    m_fileEnd += rec.size();
+
+    return true;
+}
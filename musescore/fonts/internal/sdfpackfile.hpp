@@ -0,0 +1,96 @@
+#ifndef XTZ_FONTS_SDFPACKFILE_H
+#define XTZ_FONTS_SDFPACKFILE_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include "global/io/path.h"
+#include "global/types/bytearray.h"
+
+#include "fonts/fontstypes.hpp"
+
+namespace xtz::fonts {
+//! NOTE Single append-only file with the SDF images of glyphs.
+//! The file is a header followed by records (record header, key, bitmap).
+//! Records are only appended, each one with a single write under an exclusive file lock,
+//! so several processes can share the file. A record torn by a crash is detected
+//! by its checksum and is cut off by the next writer.
+//! The file is memory mapped, the bitmaps of the found records are views into the mapping
+//! (no copies), so the mappings are kept as long as the pack exists.
+//! Only the grown part of the file is mapped (from the page before the previous end),
+//! a small grown part (records appended by other processes one by one) is read, not mapped,
+//! so the count of the mappings stays low. A part without records is dropped right away.
+//! The own appended records are not mapped, they are read from the file when found.
+//! Not thread safe, expected to be guarded by the owner.
+class SdfPackFile
+{
+public:
+    SdfPackFile() = default;
+    ~SdfPackFile();
+
+    SdfPackFile(const SdfPackFile&) = delete;
+    SdfPackFile& operator=(const SdfPackFile&) = delete;
+
+    //! NOTE Opens for read and append, creates the file if it does not exist.
+    //! A file of other version is replaced by a new one (not truncated), it can be mapped by other processes
+    bool open(const mu::io::path_t& path);
+    //! NOTE Read only, the data must outlive the pack (for example, a resource)
+    bool openData(const mu::ByteArray& data);
+    void close();
+
+    bool isOpened() const;
+    size_t count() const;
+    //! NOTE Total bytes of the bitmaps of the indexed records
+    size_t dataSize() const;
+
+    //! NOTE The bitmap of the found image is a view into the file mapping,
+    //! or a copy for the own appended records
+    bool find(const std::string& key, GlyphImage& image);
+    bool append(const std::string& key, const GlyphImage& image);
+
+    //! NOTE Rewrites the file with the live records only (a new file renamed over it, as on replace),
+    //! the duplicates and the torn tail are dropped too. If the live records are more than the max size,
+    //! only the newest of them are kept (up to the half of it). Expected before the pack is opened
+    static bool compact(const mu::io::path_t& path, size_t maxSize, const std::function<bool(std::string_view key)>& isLive);
+
+    static mu::ByteArray makeHeader();
+    static mu::ByteArray makeRecord(const std::string& key, const GlyphImage& image);
+
+private:
+
+    struct Record {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        SdfFormat format = SdfFormat::Sdf;
+        uint8_t channels = 1;
+        mu::RectF rect;
+        const uint8_t* data = nullptr;  // nullptr - not mapped, read from the data offset
+        size_t dataSize = 0;
+        uint64_t dataOffset = 0;
+    };
+
+    struct Mapping {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    // data is the file from dataPos, returns the end of the last valid record (file offsets)
+    size_t scan(const uint8_t* data, size_t dataPos, size_t size, size_t offset);
+    // maps and scans the grown part of the file, with repair expect the file lock
+    bool refresh(bool repair);
+
+    int m_fd = -1;
+    mu::ByteArray m_data;
+    std::vector<Mapping> m_mappings;
+    std::deque<mu::ByteArray> m_chunks;     // the read small parts
+    size_t m_fileEnd = 0;
+    std::unordered_map<std::string, Record> m_index;
+    size_t m_dataSize = 0;
+};
+}
+
+#endif // XTZ_FONTS_SDFPACKFILE_H
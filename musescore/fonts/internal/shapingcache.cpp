@@ -0,0 +1,144 @@
+#include "shapingcache.hpp"
+
+#include <mutex>
+
+using namespace xtz::fonts;
+
+ShapingCache::ShapingCache(size_t maxBytes)
+    : m_maxBytes(maxBytes)
+{
+}
+
+uint64_t ShapingCache::textHash(const char32_t* text, int text_length)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < text_length; ++i) {
+        h ^= static_cast<uint64_t>(text[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+size_t ShapingCache::slotBytes(const Slot& s)
+{
+    //! NOTE Approximately, including the slot and the index entry
+    static constexpr size_t OVERHEAD = 96;
+    return OVERHEAD + s.text.capacity() * sizeof(char32_t) + (s.run ? s.run->capacity() * sizeof(GlyphPos) : 0);
+}
+
+ShapingCache::GlyphRunPtr ShapingCache::find(const char32_t* text, int text_length) const
+{
+    const uint64_t hash = textHash(text, text_length);
+
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    auto it = m_index.find(hash);
+    if (it == m_index.end()) {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    const Slot& slot = m_slots[it->second];
+    if (slot.text.compare(0, std::u32string::npos, text, text_length) != 0) {
+        //! NOTE Hash collision
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    slot.referenced.store(true, std::memory_order_relaxed);
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return slot.run;
+}
+
+void ShapingCache::insert(const char32_t* text, int text_length, const GlyphRunPtr& run)
+{
+    const uint64_t hash = textHash(text, text_length);
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    //! NOTE The same text could have been inserted by another thread,
+    //! or there is a hash collision, in both cases we replace the entry
+    auto it = m_index.find(hash);
+    if (it != m_index.end()) {
+        freeSlot(it->second);
+        m_index.erase(it);
+    }
+
+    size_t idx = 0;
+    if (!m_freeSlots.empty()) {
+        idx = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        idx = m_slots.size();
+        m_slots.emplace_back();
+    }
+
+    Slot& slot = m_slots[idx];
+    slot.hash = hash;
+    slot.text.assign(text, text_length);
+    slot.run = run;
+    slot.bytes = slotBytes(slot);
+    slot.used = true;
+    //! NOTE Not referenced, so a text that is not measured again is evicted on the first pass
+    slot.referenced.store(false, std::memory_order_relaxed);
+
+    m_bytes += slot.bytes;
+    m_index[hash] = idx;
+
+    evict(idx);
+}
+
+void ShapingCache::freeSlot(size_t idx)
+{
+    Slot& slot = m_slots[idx];
+    m_bytes -= slot.bytes;
+    slot.text = std::u32string();
+    slot.run = nullptr;
+    slot.bytes = 0;
+    slot.used = false;
+    m_freeSlots.push_back(idx);
+}
+
+void ShapingCache::evict(size_t keepSlot)
+{
+    //! NOTE Two passes at most: the first one may only clear the referenced bits
+    size_t steps = m_slots.size() * 2;
+    while (m_bytes > m_maxBytes && m_index.size() > 1 && steps-- > 0) {
+        const size_t idx = m_clockHand;
+        Slot& slot = m_slots[idx];
+        m_clockHand = (m_clockHand + 1) % m_slots.size();
+
+        if (!slot.used || idx == keepSlot) {
+            continue;
+        }
+
+        if (slot.referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+
+        m_index.erase(slot.hash);
+        freeSlot(idx);
+    }
+}
+
+void ShapingCache::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_index.clear();
+    m_clockHand = 0;
+    m_bytes = 0;
+}
+
+ShapingCache::Stats ShapingCache::stats() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    Stats s;
+    s.hits = m_hits.load(std::memory_order_relaxed);
+    s.misses = m_misses.load(std::memory_order_relaxed);
+    s.count = m_index.size();
+    s.bytes = m_bytes;
+    return s;
+}
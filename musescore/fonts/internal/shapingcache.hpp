@@ -0,0 +1,77 @@
+#ifndef XTZ_FONTS_SHAPINGCACHE_H
+#define XTZ_FONTS_SHAPINGCACHE_H
+
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+
+#include "ifontface.hpp"
+
+namespace xtz::fonts {
+//! NOTE Cache of shaped texts of one face.
+//! Layout measures the same texts (dynamics, tempo, fingerings, lyrics) many times,
+//! so instead of reshaping them, we return the previously shaped glyph runs.
+//! Runs are immutable and shared, the ones not used recently are evicted (CLOCK)
+//! when the memory limit is exceeded. Hits take a shared lock and only set the referenced bit,
+//! so the threads measuring at once do not wait for each other.
+class ShapingCache
+{
+public:
+    using GlyphRun = fonts::GlyphRun;
+    using GlyphRunPtr = fonts::GlyphRunPtr;
+
+    static constexpr size_t DEFAULT_MAX_BYTES = 512 * 1024;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+
+    ShapingCache(size_t maxBytes = DEFAULT_MAX_BYTES);
+
+    GlyphRunPtr find(const char32_t* text, int text_length) const;
+    void insert(const char32_t* text, int text_length, const GlyphRunPtr& run);
+
+    void clear();
+
+    Stats stats() const;
+
+private:
+
+    struct Slot {
+        uint64_t hash = 0;
+        std::u32string text;
+        GlyphRunPtr run;
+        size_t bytes = 0;
+        bool used = false;
+        mutable std::atomic<bool> referenced { false };
+    };
+
+    static uint64_t textHash(const char32_t* text, int text_length);
+    static size_t slotBytes(const Slot& s);
+
+    // expect the unique lock
+    void freeSlot(size_t idx);
+    void evict(size_t keepSlot);
+
+    const size_t m_maxBytes = 0;
+
+    mutable std::shared_mutex m_mutex;
+    //! NOTE deque, so the slots (with atomics) are not moved
+    std::deque<Slot> m_slots;
+    std::vector<size_t> m_freeSlots;
+    std::unordered_map<uint64_t, size_t> m_index;
+    size_t m_clockHand = 0;
+    size_t m_bytes = 0;
+
+    mutable std::atomic<uint64_t> m_hits { 0 };
+    mutable std::atomic<uint64_t> m_misses { 0 };
+};
+}
+
+#endif // XTZ_FONTS_SHAPINGCACHE_H
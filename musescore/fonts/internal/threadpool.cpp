@@ -0,0 +1,124 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+using namespace xtz::fonts;
+
+ThreadPool::ThreadPool(size_t threadsCount)
+{
+    if (threadsCount == 0) {
+        threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    m_queues.reserve(threadsCount);
+    for (size_t i = 0; i < threadsCount; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+
+    m_threads.reserve(threadsCount);
+    for (size_t i = 0; i < threadsCount; ++i) {
+        m_threads.emplace_back([this, i]() { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_stop = true;
+    }
+    m_waitCv.notify_all();
+
+    for (std::thread& t : m_threads) {
+        t.join();
+    }
+}
+
+size_t ThreadPool::threadsCount() const
+{
+    return m_threads.size();
+}
+
+void ThreadPool::push(size_t queueIdx, Task&& task)
+{
+    Queue& q = *m_queues[queueIdx % m_queues.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks.push_back(std::move(task));
+}
+
+void ThreadPool::submit(Task task)
+{
+    //! NOTE Pending is increased before the push, so it never goes below zero on pop
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_pending += 1;
+    }
+
+    push(m_nextQueue.fetch_add(1), std::move(task));
+    m_waitCv.notify_one();
+}
+
+void ThreadPool::submit(std::vector<Task> tasks)
+{
+    if (tasks.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_pending += tasks.size();
+    }
+
+    const size_t first = m_nextQueue.fetch_add(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        push(first + i, std::move(tasks[i]));
+    }
+
+    m_waitCv.notify_all();
+}
+
+bool ThreadPool::pop(size_t workerIdx, Task& task)
+{
+    // own queue, from the front
+    {
+        Queue& q = *m_queues[workerIdx];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            m_pending -= 1;
+            return true;
+        }
+    }
+
+    // steal from the others, from the back
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        Queue& q = *m_queues[(workerIdx + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            m_pending -= 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run(size_t workerIdx)
+{
+    while (true) {
+        Task task;
+        if (pop(workerIdx, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_waitMutex);
+        m_waitCv.wait(lock, [this]() { return m_stop || m_pending > 0; });
+        if (m_stop && m_pending == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef XTZ_FONTS_THREADPOOL_H
+#define XTZ_FONTS_THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace xtz::fonts {
+//! NOTE Work-stealing thread pool.
+//! Each worker has its own queue and takes tasks from its front,
+//! when it is empty, the worker steals tasks from the back of the other queues.
+//! On destruction, the queued tasks are finished.
+class ThreadPool
+{
+public:
+    using Task = std::function<void ()>;
+
+    //! NOTE 0 - hardware concurrency
+    explicit ThreadPool(size_t threadsCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t threadsCount() const;
+
+    void submit(Task task);
+    //! NOTE Tasks are distributed over the worker queues
+    void submit(std::vector<Task> tasks);
+
+private:
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(size_t queueIdx, Task&& task);
+    bool pop(size_t workerIdx, Task& task);
+    void run(size_t workerIdx);
+
+    std::vector<std::unique_ptr<Queue> > m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_waitMutex;
+    std::condition_variable m_waitCv;
+    std::atomic<size_t> m_pending { 0 };
+    std::atomic<size_t> m_nextQueue { 0 };
+    bool m_stop = false;
+};
+}
+
+#endif // XTZ_FONTS_THREADPOOL_H
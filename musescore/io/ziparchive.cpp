@@ -0,0 +1,339 @@
+#include "ziparchive.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <zlib.h>
+
+#include "global/io/file.h"
+
+#include "log.h"
+
+using namespace xtz::io;
+
+static const uint32_t EOCD_SIGNATURE = 0x06054b50;
+static const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const size_t EOCD_SIZE = 22;
+static const size_t CENTRAL_HEADER_SIZE = 46;
+static const size_t LOCAL_HEADER_SIZE = 30;
+static const size_t MAX_COMMENT_SIZE = 0xFFFF;
+static const uint16_t METHOD_STORED = 0;
+static const uint16_t METHOD_DEFLATED = 8;
+static const uint16_t FLAG_ENCRYPTED = 0x1;
+
+static uint16_t readU16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t readU32(const uint8_t* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+ZipArchive::~ZipArchive()
+{
+    close();
+}
+
+bool ZipArchive::open(const mu::io::path_t& path)
+{
+    close();
+
+    //! NOTE Resource paths (":/...") are not in the file system, they are read through the file
+    //! (the resources are already in memory, the large files of the file system are mapped by it)
+    const std::string filePath = path.toStdString();
+    const bool isResource = !filePath.empty() && filePath.front() == ':';
+    if (isResource || !mapFile(filePath)) {
+        mu::io::File file(path);
+        if (!file.open(mu::io::IODevice::ReadOnly)) {
+            LOGE() << "failed open: " << path;
+            return false;
+        }
+        m_data = file.readAll();
+    }
+
+    if (!parse()) {
+        LOGE() << "failed parse zip: " << path;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool ZipArchive::mapFile(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st = {};
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    //! NOTE For example, not a regular file
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    m_mapping = p;
+    m_mappingSize = size;
+    m_data = mu::ByteArray::fromRawData(static_cast<const uint8_t*>(p), size);
+    return true;
+}
+
+bool ZipArchive::openData(const mu::ByteArray& data)
+{
+    close();
+
+    m_data = data;
+    if (!parse()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void ZipArchive::close()
+{
+    m_index.clear();
+    m_entries.clear();
+    m_data = mu::ByteArray();
+
+    if (m_mapping) {
+        ::munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+    }
+}
+
+bool ZipArchive::isOpened() const
+{
+    return !m_data.empty();
+}
+
+const uint8_t* ZipArchive::data() const
+{
+    return m_data.constData();
+}
+
+size_t ZipArchive::size() const
+{
+    return m_data.size();
+}
+
+bool ZipArchive::parse()
+{
+    const uint8_t* zip = m_data.constData();
+    const size_t size = m_data.size();
+
+    // end of central directory, is followed by a comment (usually empty)
+    size_t eocd = std::string::npos;
+    if (size >= EOCD_SIZE) {
+        const size_t minPos = size > EOCD_SIZE + MAX_COMMENT_SIZE ? size - EOCD_SIZE - MAX_COMMENT_SIZE : 0;
+        for (size_t pos = size - EOCD_SIZE + 1; pos-- > minPos;) {
+            if (readU32(zip + pos) == EOCD_SIGNATURE) {
+                eocd = pos;
+                break;
+            }
+        }
+    }
+
+    if (eocd == std::string::npos) {
+        LOGE() << "not found end of central directory, not zip data";
+        return false;
+    }
+
+    const size_t entriesCount = readU16(zip + eocd + 10);
+    const size_t dirSize = readU32(zip + eocd + 12);
+    const size_t dirOffset = readU32(zip + eocd + 16);
+    if (dirOffset + dirSize > eocd) {
+        LOGE() << "broken central directory (zip64 is not supported)";
+        return false;
+    }
+
+    m_entries.reserve(entriesCount);
+
+    size_t pos = dirOffset;
+    for (size_t i = 0; i < entriesCount; ++i) {
+        if (pos + CENTRAL_HEADER_SIZE > eocd || readU32(zip + pos) != CENTRAL_HEADER_SIGNATURE) {
+            LOGE() << "broken central directory header, entry: " << i;
+            return false;
+        }
+
+        const uint8_t* h = zip + pos;
+        const uint16_t flags = readU16(h + 8);
+        const size_t nameSize = readU16(h + 28);
+        const size_t extraSize = readU16(h + 30);
+        const size_t commentSize = readU16(h + 32);
+        const size_t localOffset = readU32(h + 42);
+
+        Entry e;
+        e.path.assign(reinterpret_cast<const char*>(h + CENTRAL_HEADER_SIZE), nameSize);
+        pos += CENTRAL_HEADER_SIZE + nameSize + extraSize + commentSize;
+
+        // dirs
+        if (e.path.empty() || e.path.back() == '/') {
+            continue;
+        }
+
+        //! NOTE The sizes are taken from the central directory,
+        //! in the local header they can be zero (followed by a data descriptor)
+        e.method = readU16(h + 10);
+        e.crc = readU32(h + 16);
+        e.compressedSize = readU32(h + 20);
+        e.size = readU32(h + 24);
+
+        if (localOffset + LOCAL_HEADER_SIZE > dirOffset || readU32(zip + localOffset) != LOCAL_HEADER_SIGNATURE) {
+            LOGE() << "broken local header, file: " << e.path;
+            continue;
+        }
+
+        const uint8_t* lh = zip + localOffset;
+        e.dataOffset = localOffset + LOCAL_HEADER_SIZE + readU16(lh + 26) + readU16(lh + 28);
+        if (e.dataOffset + e.compressedSize > dirOffset) {
+            LOGE() << "broken file data, file: " << e.path;
+            continue;
+        }
+
+        if ((flags & FLAG_ENCRYPTED) || (e.method != METHOD_STORED && e.method != METHOD_DEFLATED)) {
+            LOGE() << "not supported compression method: " << e.method << ", flags: " << flags << ", file: " << e.path;
+            continue;
+        }
+
+        //! NOTE The stored data is read by the size, only the compressed size is checked above
+        if (e.method == METHOD_STORED && e.size != e.compressedSize) {
+            LOGE() << "broken stored file, size: " << e.size << ", compressed size: " << e.compressedSize << ", file: " << e.path;
+            continue;
+        }
+
+        m_entries.push_back(std::move(e));
+    }
+
+    //! NOTE The keys are views of the entry paths, the entries are not changed after this
+    m_index.reserve(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        m_index.emplace(std::string_view(m_entries[i].path), i);
+    }
+
+    return true;
+}
+
+const std::vector<ZipArchive::Entry>& ZipArchive::entries() const
+{
+    return m_entries;
+}
+
+const ZipArchive::Entry* ZipArchive::entry(std::string_view path) const
+{
+    auto it = m_index.find(path);
+    return it != m_index.end() ? &m_entries[it->second] : nullptr;
+}
+
+bool ZipArchive::exists(std::string_view path) const
+{
+    return entry(path) != nullptr;
+}
+
+bool ZipArchive::readInto(const Entry& e, uint8_t* buf, size_t bufSize) const
+{
+    IF_ASSERT_FAILED(bufSize >= e.size) {
+        return false;
+    }
+
+    const uint8_t* src = m_data.constData() + e.dataOffset;
+
+    if (e.method == METHOD_STORED) {
+        if (!checkCrc(e, src)) {
+            return false;
+        }
+        if (e.size > 0) {
+            std::memcpy(buf, src, e.size);
+        }
+        return true;
+    }
+
+    //! NOTE Single call, the whole input and output are available, so zlib inflates
+    //! with its fast path (no window copies)
+    z_stream zs = {};
+    // raw deflate, without zlib header
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+
+    zs.next_in = const_cast<Bytef*>(src);
+    zs.avail_in = static_cast<uInt>(e.compressedSize);
+    zs.next_out = buf;
+    zs.avail_out = static_cast<uInt>(e.size);
+
+    const int ret = ::inflate(&zs, Z_FINISH);
+    const size_t outSize = zs.total_out;
+    inflateEnd(&zs);
+
+    if (ret != Z_STREAM_END || outSize != e.size) {
+        LOGE() << "failed inflate: " << e.path << ", ret: " << ret;
+        return false;
+    }
+
+    return checkCrc(e, buf);
+}
+
+bool ZipArchive::checkCrc(const Entry& e, const uint8_t* data) const
+{
+    if (crc32(crc32(0L, Z_NULL, 0), data, static_cast<uInt>(e.size)) != e.crc) {
+        LOGE() << "crc mismatch: " << e.path;
+        return false;
+    }
+    return true;
+}
+
+bool ZipArchive::read(const Entry& e, mu::ByteArray& out) const
+{
+    if (e.method == METHOD_STORED) {
+        const uint8_t* data = m_data.constData() + e.dataOffset;
+        if (!checkCrc(e, data)) {
+            return false;
+        }
+        out = mu::ByteArray::fromRawData(data, e.size);
+        return true;
+    }
+
+    mu::ByteArray data;
+    data.resize(e.size);
+    if (!readInto(e, data.data(), data.size())) {
+        return false;
+    }
+
+    out = data;
+    return true;
+}
+
+bool ZipArchive::read(std::string_view path, mu::ByteArray& out) const
+{
+    const Entry* e = entry(path);
+    if (!e) {
+        return false;
+    }
+    return read(*e, out);
+}
+
+mu::ByteArray ZipArchive::fileData(std::string_view path) const
+{
+    mu::ByteArray data;
+    read(path, data);
+    return data;
+}
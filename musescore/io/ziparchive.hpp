@@ -0,0 +1,82 @@
+#ifndef XTZ_IO_ZIPARCHIVE_H
+#define XTZ_IO_ZIPARCHIVE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+#include "global/io/path.h"
+#include "global/types/bytearray.h"
+
+namespace xtz::io {
+//! NOTE Read-only zip archive, the central directory is parsed once on open.
+//! The archive is memory mapped (or read, or the data is borrowed), the stored entries
+//! are returned as views into it (no copies), the deflated ones are inflated
+//! directly into the output (a new buffer or a buffer of the caller).
+//! Only stored and deflated entries, no zip64 and no encryption.
+//! The CRC of an entry is checked on each read (for the views too).
+//! The views are valid while the archive is opened.
+//! After open, the methods are const and do not change anything, so the archive
+//! can be read from several threads at once.
+class ZipArchive
+{
+public:
+    struct Entry {
+        std::string path;
+        size_t dataOffset = 0;
+        size_t compressedSize = 0;
+        size_t size = 0;
+        uint32_t crc = 0;
+        uint16_t method = 0;
+
+        bool isStored() const { return method == 0; }
+    };
+
+    ZipArchive() = default;
+    ~ZipArchive();
+
+    ZipArchive(const ZipArchive&) = delete;
+    ZipArchive& operator=(const ZipArchive&) = delete;
+
+    //! NOTE A file of the file system is mapped, a resource (":/...") is read
+    bool open(const mu::io::path_t& path);
+    //! NOTE The data is shared, if it is a raw data view, the data must outlive the archive
+    bool openData(const mu::ByteArray& data);
+    void close();
+
+    bool isOpened() const;
+
+    //! NOTE The whole archive
+    const uint8_t* data() const;
+    size_t size() const;
+
+    const std::vector<Entry>& entries() const;
+    const Entry* entry(std::string_view path) const;
+    bool exists(std::string_view path) const;
+
+    //! NOTE Stored - a view into the archive, deflated - a new inflated buffer
+    bool read(const Entry& e, mu::ByteArray& out) const;
+    bool read(std::string_view path, mu::ByteArray& out) const;
+    mu::ByteArray fileData(std::string_view path) const;
+
+    //! NOTE The buffer must have at least the entry size
+    bool readInto(const Entry& e, uint8_t* buf, size_t bufSize) const;
+
+private:
+
+    // expect the archive is closed
+    bool mapFile(const std::string& path);
+    bool parse();
+    bool checkCrc(const Entry& e, const uint8_t* data) const;
+
+    mu::ByteArray m_data;
+    void* m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string_view, size_t> m_index;
+};
+}
+
+#endif // XTZ_IO_ZIPARCHIVE_H
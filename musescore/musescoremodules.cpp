@@ -28,12 +28,16 @@ std::string moduleName()
 void MuseScoreModules::setup()
 {
     // Resources
+    //! NOTE Only the bundles are remembered, they are indexed on the first access to their dirs
     INIT_RESOURCE(fonts_Edwin);
     INIT_RESOURCE(fonts_MuseScoreTab);
     INIT_RESOURCE(fonts_Bravura);
     INIT_RESOURCE(fonts_Leland);
     INIT_RESOURCE(notations);
     INIT_RESOURCE(smufl);
+#ifdef XTZ_USE_SDFCACHE_RESOURCE
+    INIT_RESOURCE(sdfcache);
+#endif
 
     // Global
     ioc()->registerExport<mu::io::IFileSystem>(moduleName(), new xtz::io::FileSystem());
@@ -0,0 +1,50 @@
+#ifndef XTZ_IO_RESOURCESPACK_H
+#define XTZ_IO_RESOURCESPACK_H
+
+#include <cstdint>
+
+//! NOTE The format of the resource pack (tools/rcpack), embedded into the binary as is
+//! and read by ResourcesRegister without parsing or copying.
+//!
+//! Header, directories, files, names, data (all little endian, the tables are aligned to 8).
+//! The files are sorted by directory and then by name, so the files of a directory
+//! are a continuous range, the directories are sorted by path (root is the empty path).
+//! The file data is not compressed, aligned to 16.
+namespace xtz::io::rcpack {
+static constexpr char MAGIC[4] = { 'X', 'R', 'C', 'P' };
+static constexpr uint32_t VERSION = 1;
+static constexpr uint32_t DATA_ALIGN = 16;
+
+struct Header {
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t dirsCount = 0;
+    uint32_t filesCount = 0;
+    uint32_t dirsOffset = 0;
+    uint32_t filesOffset = 0;
+    uint32_t namesOffset = 0;
+    uint32_t namesSize = 0;
+};
+
+struct DirEntry {
+    uint32_t pathOffset = 0;    // in names, without a trailing slash
+    uint32_t pathSize = 0;
+    uint32_t firstFile = 0;
+    uint32_t filesCount = 0;
+};
+
+struct FileEntry {
+    uint32_t pathOffset = 0;    // in names, the full path (directory / name)
+    uint32_t pathSize = 0;
+    uint32_t nameSize = 0;      // the name is the tail of the path
+    uint32_t reserved = 0;
+    uint64_t dataOffset = 0;    // from the start of the pack
+    uint64_t dataSize = 0;
+};
+
+static_assert(sizeof(Header) == 32, "unexpected header size");
+static_assert(sizeof(DirEntry) == 16, "unexpected dir entry size");
+static_assert(sizeof(FileEntry) == 32, "unexpected file entry size");
+}
+
+#endif // XTZ_IO_RESOURCESPACK_H
@@ -1,7 +1,13 @@
 #include "resourcesregister.h"
 
-#include "global/serialization/zipreader.h"
-#include "global/io/buffer.h"
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "log.h"
 
@@ -13,8 +19,16 @@ void RegisterResourceData(const std::vector<std::string>& files, const uint8_t*
 {
     ResourcesRegister::instance()->addData(files, ByteArray::fromRawData(data, dataSize));
 }
+
+void RegisterResourcePack(const uint8_t* data, const size_t dataSize)
+{
+    ResourcesRegister::instance()->addPack(data, dataSize);
+}
 }
 
+//! NOTE The inflated files are kept while they fit, the oldest ones are dropped first
+static const size_t INFLATED_CACHE_LIMIT = 32 * 1024 * 1024;
+
 static bool startsWith(const std::string& str, const std::string& start)
 {
     if (start.size() > str.size()) {
@@ -30,16 +44,50 @@ static bool startsWith(const std::string& str, const std::string& start)
     return true;
 }
 
-static std::string remove_sheme(const std::string& path)
+// the dir of the path with the scheme, without a trailing slash (":" for the root)
+static std::string dirOf(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+enum class Advice {
+    Random,
+    WillNeed
+};
+
+//! NOTE The resources are in the read-only data of the binary, its pages are loaded on access,
+//! with read-ahead (and fault-around) that also loads the neighbour pages of the not used bundles.
+//! Only the pages that are fully inside the range are advised, not to affect the neighbours.
+static void advise(const uint8_t* data, size_t size, Advice advice)
 {
-    if (path.size() < 3) {
-        return std::string();
+#ifdef __linux__
+    static const uintptr_t pageSize = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + pageSize - 1) & ~(pageSize - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + size) & ~(pageSize - 1);
+    if (end <= begin) {
+        return;
     }
 
-    if (path.at(0) == ':') {
-        return path.substr(2);
+    ::madvise(reinterpret_cast<void*>(begin), end - begin, advice == Advice::Random ? MADV_RANDOM : MADV_WILLNEED);
+#else
+    UNUSED(data);
+    UNUSED(size);
+    UNUSED(advice);
+#endif
+}
+
+// the pack paths are without the scheme
+static std::string_view packPath(const std::string& path)
+{
+    std::string_view p(path);
+    if (p.size() >= 2 && p[0] == ':' && p[1] == '/') {
+        p.remove_prefix(2);
     }
-    return path;
+    while (!p.empty() && p.back() == '/') {
+        p.remove_suffix(1);
+    }
+    return p;
 }
 
 ResourcesRegister* ResourcesRegister::instance()
@@ -50,57 +98,280 @@ ResourcesRegister* ResourcesRegister::instance()
 
 void ResourcesRegister::addData(const std::vector<std::string>& files, ByteArray data)
 {
-    for (size_t i = 0; i < files.size(); ++i) {
-        std::string file = ":/" + files.at(i);
-        IF_ASSERT_FAILED(m_data.find(file) == m_data.end()) {
+    //! NOTE Not touched until the first access
+    advise(data.constData(), data.size(), Advice::Random);
+
+    std::unique_lock lock(m_mutex);
+
+    const size_t idx = m_bundles.size();
+    Bundle bundle;
+    bundle.files = files;
+    bundle.data = data;
+    m_bundles.push_back(std::move(bundle));
+
+    for (const std::string& file : files) {
+        std::vector<size_t>& bundles = m_bundleDirs[dirOf(":/" + file)];
+        if (bundles.empty() || bundles.back() != idx) {
+            bundles.push_back(idx);
+        }
+    }
+}
+
+void ResourcesRegister::indexBundles(const std::string& dirPath)
+{
+    bool hasNotIndexed = false;
+    {
+        std::shared_lock lock(m_mutex);
+        auto it = m_bundleDirs.find(dirPath);
+        if (it == m_bundleDirs.end()) {
+            return;
+        }
+
+        for (size_t idx : it->second) {
+            hasNotIndexed |= !m_bundles.at(idx).indexed;
+        }
+    }
+
+    if (!hasNotIndexed) {
+        return;
+    }
+
+    std::unique_lock lock(m_mutex);
+    for (size_t idx : m_bundleDirs.at(dirPath)) {
+        Bundle& bundle = m_bundles.at(idx);
+        if (!bundle.indexed) {
+            indexBundle(bundle);
+            bundle.indexed = true;
+        }
+    }
+}
+
+void ResourcesRegister::indexBundle(Bundle& bundle)
+{
+    bundle.zip = std::make_unique<ZipArchive>();
+    IF_ASSERT_FAILED(bundle.zip->openData(bundle.data)) {
+        LOGE() << "resource data is not zip";
+        return;
+    }
+
+    for (const std::string& file : bundle.files) {
+        const ZipArchive::Entry* e = bundle.zip->entry(file);
+        if (!e) {
+            LOGE() << "not found in resource data, file: " << file;
+            continue;
+        }
+
+        std::string path = ":/" + file;
+        IF_ASSERT_FAILED(m_entries.find(path) == m_entries.end()) {
             continue;
         }
 
-        m_data[file] = data;
+        m_entries[path] = { bundle.zip.get(), e };
     }
 }
 
+void ResourcesRegister::addPack(const uint8_t* data, size_t size)
+{
+    IF_ASSERT_FAILED(data && size >= sizeof(rcpack::Header)) {
+        return;
+    }
+
+    const rcpack::Header* h = reinterpret_cast<const rcpack::Header*>(data);
+    IF_ASSERT_FAILED(std::memcmp(h->magic, rcpack::MAGIC, sizeof(h->magic)) == 0 && h->version == rcpack::VERSION) {
+        LOGE() << "resource pack has not expected header";
+        return;
+    }
+
+    IF_ASSERT_FAILED(size_t(h->dirsOffset) + size_t(h->dirsCount) * sizeof(rcpack::DirEntry) <= size
+                     && size_t(h->filesOffset) + size_t(h->filesCount) * sizeof(rcpack::FileEntry) <= size
+                     && size_t(h->namesOffset) + h->namesSize <= size) {
+        LOGE() << "broken resource pack";
+        return;
+    }
+
+    Pack pack;
+    pack.data = data;
+    pack.size = size;
+    pack.dirs = reinterpret_cast<const rcpack::DirEntry*>(data + h->dirsOffset);
+    pack.dirsCount = h->dirsCount;
+    pack.files = reinterpret_cast<const rcpack::FileEntry*>(data + h->filesOffset);
+    pack.names = reinterpret_cast<const char*>(data + h->namesOffset);
+
+    //! NOTE Only the index and the read files are touched
+    advise(data, size, Advice::Random);
+
+    std::unique_lock lock(m_mutex);
+    m_packs.push_back(pack);
+}
+
+const rcpack::DirEntry* ResourcesRegister::findDir(const Pack& pack, std::string_view dirPath)
+{
+    const rcpack::DirEntry* end = pack.dirs + pack.dirsCount;
+    const rcpack::DirEntry* it = std::lower_bound(pack.dirs, end, dirPath,
+                                                  [&pack](const rcpack::DirEntry& d, std::string_view p) {
+        return std::string_view(pack.names + d.pathOffset, d.pathSize) < p;
+    });
+
+    if (it == end || std::string_view(pack.names + it->pathOffset, it->pathSize) != dirPath) {
+        return nullptr;
+    }
+    return it;
+}
+
+const rcpack::FileEntry* ResourcesRegister::findFile(const Pack& pack, std::string_view filePath)
+{
+    const size_t slash = filePath.rfind('/');
+    const std::string_view dirPath = slash == std::string_view::npos ? std::string_view() : filePath.substr(0, slash);
+    const std::string_view name = slash == std::string_view::npos ? filePath : filePath.substr(slash + 1);
+
+    const rcpack::DirEntry* dir = findDir(pack, dirPath);
+    if (!dir) {
+        return nullptr;
+    }
+
+    // the files of the dir are sorted by name, the name is the tail of the path
+    auto fileName = [&pack](const rcpack::FileEntry& f) {
+        return std::string_view(pack.names + f.pathOffset + f.pathSize - f.nameSize, f.nameSize);
+    };
+
+    const rcpack::FileEntry* begin = pack.files + dir->firstFile;
+    const rcpack::FileEntry* end = begin + dir->filesCount;
+    const rcpack::FileEntry* it = std::lower_bound(begin, end, name, [&fileName](const rcpack::FileEntry& f, std::string_view n) {
+        return fileName(f) < n;
+    });
+
+    if (it == end || fileName(*it) != name) {
+        return nullptr;
+    }
+    return it;
+}
+
 void ResourcesRegister::destroy()
 {
-    m_data.clear();
+    {
+        std::lock_guard cacheLock(m_cacheMutex);
+        m_inflated.clear();
+        m_inflatedOrder.clear();
+        m_inflatedBytes = 0;
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_entries.clear();
+    m_bundles.clear();
+    m_bundleDirs.clear();
+    m_packs.clear();
 }
 
 bool ResourcesRegister::exists(const std::string& filePath)
 {
-    return m_data.find(filePath) != m_data.end();
+    indexBundles(dirOf(filePath));
+
+    std::shared_lock lock(m_mutex);
+    for (const Pack& pack : m_packs) {
+        if (findFile(pack, packPath(filePath))) {
+            return true;
+        }
+    }
+    return m_entries.find(filePath) != m_entries.end();
 }
 
 bool ResourcesRegister::readFile(const std::string& filePath, ByteArray& fileData)
 {
-    auto it = m_data.find(filePath);
-    if (it == m_data.end()) {
-        LOGE() << "not found file: " << filePath;
+    indexBundles(dirOf(filePath));
+
+    FileRef f;
+    {
+        std::shared_lock lock(m_mutex);
+        for (const Pack& pack : m_packs) {
+            if (const rcpack::FileEntry* pf = findFile(pack, packPath(filePath))) {
+                advise(pack.data + pf->dataOffset, static_cast<size_t>(pf->dataSize), Advice::WillNeed);
+                fileData = ByteArray::fromRawData(pack.data + pf->dataOffset, static_cast<size_t>(pf->dataSize));
+                return true;
+            }
+        }
+
+        auto it = m_entries.find(filePath);
+        if (it == m_entries.end()) {
+            LOGE() << "not found file: " << filePath;
+            return false;
+        }
+        f = it->second;
+    }
+
+    advise(f.zip->data() + f.entry->dataOffset, f.entry->compressedSize, Advice::WillNeed);
+
+    if (f.entry->isStored()) {
+        return f.zip->read(*f.entry, fileData);
+    }
+
+    {
+        std::lock_guard cacheLock(m_cacheMutex);
+        auto it = m_inflated.find(filePath);
+        if (it != m_inflated.end()) {
+            fileData = it->second;
+            return true;
+        }
+    }
+
+    //! NOTE Inflated without the lock, if several threads read the same file, the first one is cached
+    ByteArray data;
+    if (!f.zip->read(*f.entry, data)) {
+        LOGE() << "failed inflate file: " << filePath;
         return false;
     }
 
-    ByteArray& zipData = it->second;
-    mu::io::Buffer buf(&zipData);
+    fileData = data;
+
+    if (data.size() > INFLATED_CACHE_LIMIT) {
+        return true;
+    }
+
+    std::lock_guard cacheLock(m_cacheMutex);
+    if (!m_inflated.emplace(filePath, data).second) {
+        return true;
+    }
 
-    mu::ZipReader zip(&buf);
-    fileData = zip.fileData(remove_sheme(filePath));
+    m_inflatedOrder.push_back(filePath);
+    m_inflatedBytes += data.size();
 
-    if (fileData.empty()) {
-        LOGW() << "the file is empty, may not be found, path: " << filePath;
-        LOGI() << "has files: ";
-        std::vector<ZipReader::FileInfo> files = zip.fileInfoList();
-        for (const ZipReader::FileInfo& fi : files) {
-            LOGI() << "    " << fi.filePath;
+    while (m_inflatedBytes > INFLATED_CACHE_LIMIT && !m_inflatedOrder.empty()) {
+        auto it = m_inflated.find(m_inflatedOrder.front());
+        m_inflatedOrder.pop_front();
+        if (it != m_inflated.end()) {
+            m_inflatedBytes -= it->second.size();
+            m_inflated.erase(it);
         }
     }
 
-    return !zip.hasError();
+    return true;
 }
 
 mu::io::paths_t ResourcesRegister::scanFiles(const std::string& rootPath)
 {
+    std::string dirPath = rootPath;
+    while (dirPath.size() > 1 && dirPath.back() == '/') {
+        dirPath.pop_back();
+    }
+    indexBundles(dirPath);
+
+    std::shared_lock lock(m_mutex);
+
     mu::io::paths_t paths;
+
+    for (const Pack& pack : m_packs) {
+        const rcpack::DirEntry* dir = findDir(pack, packPath(rootPath));
+        if (!dir) {
+            continue;
+        }
+
+        for (uint32_t i = dir->firstFile; i < dir->firstFile + dir->filesCount; ++i) {
+            const rcpack::FileEntry& f = pack.files[i];
+            paths.push_back(std::string(pack.names + f.pathOffset + f.pathSize - f.nameSize, f.nameSize));
+        }
+    }
+
     size_t relStart = rootPath.back() == '/' ? rootPath.size() : (rootPath.size() + 1);
-    for (auto it = m_data.begin(); it != m_data.end(); ++it) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
         const std::string& filePath = it->first;
         if (!startsWith(filePath, rootPath)) {
             continue;
@@ -4,22 +4,44 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <memory>
 
 #include "global/io/path.h"
 #include "global/types/bytearray.h"
 
+#include "resourcespack.h"
+#include "io/ziparchive.hpp"
+
 #define INIT_RESOURCE(name) \
     extern void InitResources_##name(); \
     InitResources_##name(); \
 
 namespace xtz::io {
+//! NOTE Resources are registered as zip data (embedded into the binary) by bundles,
+//! on adding only the directories of the bundle files are remembered, the central directory
+//! is parsed on the first access to a path of these directories (a job that uses
+//! a single music font does not touch the others, so their pages are not loaded).
+//! The stored (not compressed) files are returned as views into the zip data (no copies),
+//! the deflated ones are inflated on read and kept in a cache of limited size,
+//! the cached data is shared with the callers, so it must not be modified.
+//! Resources can also be registered as packs (tools/rcpack, the files are not compressed),
+//! the index of a pack is used in place (binary search), the files are views into the pack.
+//! Thread safe.
 class ResourcesRegister
 {
 public:
 
     static ResourcesRegister* instance();
 
+    //! NOTE The data must outlive the register (for example, a static array)
     void addData(const std::vector<std::string>& files, mu::ByteArray data);
+    //! NOTE The pack must outlive the register (embedded into the binary)
+    void addPack(const uint8_t* data, size_t size);
 
     bool exists(const std::string& filePath);
     bool readFile(const std::string& filePath, mu::ByteArray& fileData);
@@ -29,7 +51,44 @@ public:
 
 private:
 
-    std::map<std::string, mu::ByteArray> m_data;
+    struct Bundle {
+        std::vector<std::string> files;
+        mu::ByteArray data;
+        bool indexed = false;
+        std::unique_ptr<ZipArchive> zip;
+    };
+
+    struct FileRef {
+        const ZipArchive* zip = nullptr;
+        const ZipArchive::Entry* entry = nullptr;
+    };
+
+    struct Pack {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        const rcpack::DirEntry* dirs = nullptr;
+        size_t dirsCount = 0;
+        const rcpack::FileEntry* files = nullptr;
+        const char* names = nullptr;
+    };
+
+    static const rcpack::DirEntry* findDir(const Pack& pack, std::string_view dirPath);
+    static const rcpack::FileEntry* findFile(const Pack& pack, std::string_view filePath);
+
+    // dirPath with the scheme and without a trailing slash
+    void indexBundles(const std::string& dirPath);
+    void indexBundle(Bundle& bundle);
+
+    mutable std::shared_mutex m_mutex;
+    std::vector<Bundle> m_bundles;
+    std::map<std::string, std::vector<size_t> > m_bundleDirs;
+    std::vector<Pack> m_packs;
+    std::map<std::string, FileRef> m_entries;
+
+    std::mutex m_cacheMutex;
+    std::unordered_map<std::string, mu::ByteArray> m_inflated;
+    std::deque<std::string> m_inflatedOrder;
+    size_t m_inflatedBytes = 0;
 };
 }
 
@@ -39,13 +39,27 @@ void SymbolMetricsFM::load(const std::string& family, const mu::io::path_t& path
     double size = 20.0 * MScore::pixelRatio;
     m_font.setPointSizeF(size);
 
+    //! NOTE Two codes per symbol (smufl and music symbol block), queried with one batch
+    std::vector<char32_t> codes(m_symbols.size() * 2, 0);
     for (size_t id = 0; id < m_symbols.size(); ++id) {
         Smufl::Code code = Smufl::code(static_cast<SymId>(id));
         if (!code.isValid()) {
             continue;
         }
-        Sym& sym = m_symbols[id];
-        computeMetrics(sym, code);
+        codes[id * 2] = code.smuflCode;
+        codes[id * 2 + 1] = code.musicSymBlockCode;
+    }
+
+    std::vector<xtz::fonts::SymMetrics> metrics = fontsEngine()->symMetrics(m_font, codes);
+    IF_ASSERT_FAILED(metrics.size() == codes.size()) {
+        return;
+    }
+
+    for (size_t id = 0; id < m_symbols.size(); ++id) {
+        if (codes[id * 2] == 0 && codes[id * 2 + 1] == 0) {
+            continue;
+        }
+        computeMetrics(m_symbols[id], metrics[id * 2], metrics[id * 2 + 1]);
     }
 
     File metadataFile(FileInfo(m_fontPath).path() + u"/metadata.json");
@@ -421,7 +435,9 @@ void SymbolMetricsFM::loadStylisticAlternates(const JsonObject& glyphsWithAltern
                 }
 
                 if (code.smuflCode || code.musicSymBlockCode) {
-                    computeMetrics(sym, code);
+                    std::vector<xtz::fonts::SymMetrics> metrics
+                        = fontsEngine()->symMetrics(m_font, { code.smuflCode, code.musicSymBlockCode });
+                    computeMetrics(sym, metrics.at(0), metrics.at(1));
                 }
             }
         }
@@ -513,16 +529,20 @@ void SymbolMetricsFM::loadEngravingDefaults(const JsonObject& engravingDefaultsO
     m_engravingDefaults.insert({ Sid::MusicalTextFont, String(u"%1 Text").arg(String::fromStdString(m_family)) });
 }
 
-void SymbolMetricsFM::computeMetrics(Sym& sym, const Smufl::Code& code)
+void SymbolMetricsFM::computeMetrics(Sym& sym, const xtz::fonts::SymMetrics& smufl, const xtz::fonts::SymMetrics& musicSymBlock)
 {
-    if (fontProvider()->inFontUcs4(m_font, code.smuflCode)) {
-        sym.code = code.smuflCode;
-    } else if (fontProvider()->inFontUcs4(m_font, code.musicSymBlockCode)) {
-        sym.code = code.musicSymBlockCode;
+    const xtz::fonts::SymMetrics* m = nullptr;
+    if (smufl.inFont) {
+        m = &smufl;
+    } else if (musicSymBlock.inFont) {
+        m = &musicSymBlock;
     }
 
-    if (sym.code > 0) {
-        sym.bbox = fontProvider()->symBBox(m_font, sym.code, DPI_F);
-        sym.advance = fontProvider()->symAdvance(m_font, sym.code, DPI_F);
+    if (!m) {
+        return;
     }
+
+    sym.code = m->code;
+    sym.bbox = m->bbox;
+    sym.advance = m->advance;
 }
@@ -8,6 +8,7 @@
 
 #include "modularity/ioc.h"
 #include "draw/ifontprovider.h"
+#include "fonts/ifontsengine.hpp"
 
 #include "draw/types/font.h"
 #include "engraving/infrastructure/smufl.h"
@@ -20,6 +21,7 @@ namespace xtz::notation {
 class SymbolMetricsFM : public ISymbolMetrics
 {
     INJECT_STATIC(xtz::notation, mu::draw::IFontProvider, fontProvider)
+    INJECT_STATIC(xtz::notation, xtz::fonts::IFontsEngine, fontsEngine)
 public:
     SymbolMetricsFM();
 
@@ -60,7 +62,7 @@ private:
     void loadComposedGlyphs();
     void loadStylisticAlternates(const mu::JsonObject& glyphsWithAlternatesObject);
     void loadEngravingDefaults(const mu::JsonObject& engravingDefaultsObject);
-    void computeMetrics(Sym& sym, const mu::engraving::Smufl::Code& code);
+    void computeMetrics(Sym& sym, const xtz::fonts::SymMetrics& smufl, const xtz::fonts::SymMetrics& musicSymBlock);
 
     const Sym& sym(mu::engraving::SymId id) const;
     Sym& sym(mu::engraving::SymId id);
@@ -99,7 +99,8 @@ private:
 
 namespace
 {
-	WindingSpanner Spanner;
+	// thread_local, so that SDF can be generated from several threads at the same time
+	thread_local WindingSpanner Spanner;
 }
 
 void generateSDF(Bitmap<unsigned char> &output, const Shape &shape, double bound_l, double range, const Vector2 &scale, const Vector2 &translate) {
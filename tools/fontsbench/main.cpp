@@ -0,0 +1,612 @@
+//! NOTE Stress tests and benchmarks of the fonts engine on the bundled fonts.
+//! Each test prints its numbers and returns non-zero if its check fails.
+//!
+//! usage: fontsbench <out_dir> [--threads <count>] [--iterations <count>] [stress] [resolve] [shaping] [shaperate] [allocs]
+//!
+//! stress - the threads query the metrics, symbols and render of many fonts and sizes
+//! on a fresh engine at once, and compare each result with the one computed on one thread before
+//! resolve - the cost of a metrics call by a font (resolving the face each time) with 1 ... 1000
+//! pixel sizes in use, fails if it grows with the number of the sizes
+//! shaping - measures the texts of a text-heavy score many times and counts the texts shaped by HarfBuzz
+//! (the shaping cache misses) against the measured ones, fails if a repeated text is shaped again
+//! shaperate - shapes per second of short Latin strings with HarfBuzz, a new buffer and the features
+//! for each call (as before) against a reused buffer and a cached shape plan (as FontFaceFT),
+//! and the rate of the engine for texts that are not in the shaping cache
+//! allocs - counts the heap allocations of horizontalAdvance and boundingRect (by a font and by a handle)
+//! for the warm texts, fails if there is any
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+
+#include "musescoremodules.h"
+
+#include <hb.h>
+
+#include "global/io/file.h"
+#include "global/io/fileinfo.h"
+
+#include "fonts/internal/fontsengine.hpp"
+#include "fonts/internal/fontfaceft.hpp"
+#include "fonts/internal/fontfacext.hpp"
+#include "fonts/internal/fontfacedu.hpp"
+
+#include "log.h"
+
+using namespace mu;
+using namespace mu::draw;
+using namespace xtz::fonts;
+
+struct FontInfo {
+    std::string family;
+    Font::Type type = Font::Type::Undefined;
+    bool bold = false;
+    bool italic = false;
+};
+
+//! NOTE Fonts registered in FontsModule::onInit
+static const std::vector<FontInfo> TEXT_FONTS = {
+    { "Edwin", Font::Type::Text, false, false },
+    { "Edwin", Font::Type::Text, false, true },
+    { "Edwin", Font::Type::Text, true, false },
+    { "Edwin", Font::Type::Text, true, true },
+    { "Leland Text", Font::Type::MusicSymbolText },
+    { "MuseScoreTab", Font::Type::Tablature },
+};
+
+static const std::vector<FontInfo> SYMBOL_FONTS = {
+    { "Bravura", Font::Type::MusicSymbol },
+    { "Leland", Font::Type::MusicSymbol },
+};
+
+//! NOTE What layout measures over and over: dynamics, tempo, instrument names, lyrics, fingerings
+static const std::vector<std::u32string> TEXTS = {
+    U"Allegro moderato", U"mf", U"cresc.", U"dim.", U"Violin I", U"Violoncello", U"la", U"-", U"glo", U"ri",
+    U"1.", U"2.", U"3", U"Fine", U"D.C. al Fine", U"rit.", U"a tempo", U"pizz.", U"arco", U"Solo\nTutti",
+};
+
+//! NOTE G clef, F clef, black notehead, quarter rest, sharp, flat
+static const std::vector<char32_t> SYMBOLS = { 0xE050, 0xE062, 0xE0A4, 0xE4E5, 0xE262, 0xE260 };
+
+static const std::vector<double> POINT_SIZES = { 6.0, 8.0, 9.5, 10.0, 11.0, 12.0, 14.0, 18.0, 20.0, 24.0, 32.0 };
+
+static Font makeFont(const FontInfo& fi, double pointSize)
+{
+    Font f;
+    f.setFamily(String::fromStdString(fi.family), fi.type);
+    f.setBold(fi.bold);
+    f.setItalic(fi.italic);
+    f.setPointSizeF(pointSize);
+    return f;
+}
+
+static std::shared_ptr<FontsEngine> makeEngine(const std::string& cacheDir)
+{
+    std::shared_ptr<FontsEngine> engine = std::make_shared<FontsEngine>();
+    engine->setRenderCacheDirPath(cacheDir);
+    return engine;
+}
+
+// ================ stress ================
+
+struct Case {
+    Font font;
+    std::u32string text;
+    char32_t sym = 0;
+};
+
+struct Result {
+    double advance = 0.0;
+    RectF bbox;
+    RectF tightBbox;
+    double lineSpacing = 0.0;
+    double ascent = 0.0;
+    double descent = 0.0;
+    std::vector<RectF> rendered;
+
+    bool operator==(const Result& o) const
+    {
+        if (advance != o.advance || bbox != o.bbox || tightBbox != o.tightBbox
+            || lineSpacing != o.lineSpacing || ascent != o.ascent || descent != o.descent) {
+            return false;
+        }
+
+        return rendered == o.rendered;
+    }
+};
+
+static Result compute(const FontsEngine* engine, const Case& c)
+{
+    Result r;
+    if (c.sym != 0) {
+        r.advance = engine->symAdvance(c.font, c.sym);
+        r.bbox = engine->symBBox(c.font, c.sym);
+        return r;
+    }
+
+    r.advance = engine->horizontalAdvance(c.font, c.text);
+    r.bbox = engine->boundingRect(c.font, c.text);
+    r.tightBbox = engine->tightBoundingRect(c.font, c.text);
+    r.lineSpacing = engine->lineSpacing(c.font);
+    r.ascent = engine->ascent(c.font);
+    r.descent = engine->descent(c.font);
+
+    //! NOTE The atlas place depends on the order of the rendering, only the glyph rects are compared
+    for (const AtlasGlyph& g : engine->render(c.font, c.text)) {
+        r.rendered.push_back(g.rect);
+    }
+
+    return r;
+}
+
+static int stress(const std::string& outDir, size_t threadsCount, size_t iterations)
+{
+    std::vector<Case> cases;
+    for (double size : POINT_SIZES) {
+        for (const FontInfo& fi : TEXT_FONTS) {
+            for (const std::u32string& text : TEXTS) {
+                cases.push_back({ makeFont(fi, size), text, 0 });
+            }
+        }
+        for (const FontInfo& fi : SYMBOL_FONTS) {
+            for (char32_t sym : SYMBOLS) {
+                cases.push_back({ makeFont(fi, size), std::u32string(), sym });
+            }
+        }
+    }
+
+    std::vector<Result> reference;
+    {
+        std::shared_ptr<FontsEngine> engine = makeEngine(outDir + "stress_ref/");
+        reference.reserve(cases.size());
+        for (const Case& c : cases) {
+            reference.push_back(compute(engine.get(), c));
+        }
+    }
+
+    //! NOTE A fresh engine, so that the threads race on the cold paths too
+    //! (loading of faces, shaping, generating of SDF), not only on the caches
+    std::shared_ptr<FontsEngine> engine = makeEngine(outDir + "stress/");
+
+    std::atomic<size_t> mismatches { 0 };
+    std::atomic<size_t> calls { 0 };
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadsCount; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t it = 0; it < iterations; ++it) {
+                //! NOTE Each thread goes through the cases in its own order
+                for (size_t i = 0; i < cases.size(); ++i) {
+                    const size_t idx = (i * (2 * t + 1) + it * 7) % cases.size();
+                    if (!(compute(engine.get(), cases[idx]) == reference[idx])) {
+                        mismatches.fetch_add(1);
+                    }
+                    calls.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                //! NOTE The prewarm and the change of the workers race with the queries
+                if (t == 0) {
+                    engine->prewarm(cases[it % cases.size()].font, { U'a', U'b', U'c' });
+                    engine->setWorkersCount(1 + it % 4);
+                }
+            }
+        });
+    }
+
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::cout << "stress: threads: " << threadsCount << ", cases: " << cases.size() << ", calls: " << calls
+              << ", time: " << sec << " s, calls/sec: " << static_cast<size_t>(sec > 0.0 ? calls / sec : 0.0)
+              << ", mismatches: " << mismatches << std::endl;
+
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ================ resolve ================
+
+//! NOTE The hashed lookup may get somewhat slower when the table does not fit the CPU cache,
+//! a linear scan would be hundreds of times slower at 1000 sizes
+static const double RESOLVE_MAX_GROWTH = 3.0;
+
+static int resolve(const std::string& outDir, size_t iterations)
+{
+    std::shared_ptr<FontsEngine> engine = makeEngine(outDir + "resolve/");
+
+    const FontInfo fi = TEXT_FONTS.front();
+    const size_t calls = iterations * 100000;
+
+    double baseNs = 0.0;
+    double maxNs = 0.0;
+    for (size_t sizesCount : { 1, 10, 100, 300, 1000 }) {
+        //! NOTE Each font has its own pixel size, so its own required face
+        std::vector<Font> fonts;
+        for (size_t i = 0; i < sizesCount; ++i) {
+            fonts.push_back(makeFont(fi, (8.0 + i + 0.5) * 72.0 / DPI));
+            engine->ascent(fonts.back());
+        }
+
+        double sum = 0.0;
+        auto startTime = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; ++i) {
+            sum += engine->ascent(fonts[i % sizesCount]);
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / calls;
+
+        if (sizesCount == 1) {
+            baseNs = ns;
+        }
+        maxNs = std::max(maxNs, ns);
+
+        std::cout << "resolve: sizes: " << sizesCount << ", calls: " << calls << ", ns/call: " << ns
+                  << " (checksum " << static_cast<long long>(sum) << ")" << std::endl;
+    }
+
+    //! NOTE For comparison, the same call by the resolved handle (no lookup at all)
+    {
+        const FontHandle h = engine->resolve(makeFont(fi, 12.0));
+        double sum = 0.0;
+        auto startTime = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; ++i) {
+            sum += engine->ascent(h);
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / calls;
+        std::cout << "resolve: by handle, ns/call: " << ns << " (checksum " << static_cast<long long>(sum) << ")" << std::endl;
+    }
+
+    const double growth = baseNs > 0.0 ? maxNs / baseNs : 0.0;
+    std::cout << "resolve: growth from 1 to 1000 sizes: " << growth << std::endl;
+
+    return growth <= RESOLVE_MAX_GROWTH ? 0 : 1;
+}
+
+// ================ shaping ================
+
+//! NOTE The faces register themselves, so that their shaping stats can be collected
+class CountedFaceFT : public FontFaceFT
+{
+public:
+    CountedFaceFT(std::mutex& mutex, std::vector<const FontFaceFT*>& faces)
+        : m_mutex(mutex), m_faces(faces)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_faces.push_back(this);
+    }
+
+    ~CountedFaceFT() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_faces.erase(std::find(m_faces.begin(), m_faces.end(), this));
+    }
+
+private:
+    std::mutex& m_mutex;
+    std::vector<const FontFaceFT*>& m_faces;
+};
+
+static ShapingCache::Stats shapingStats(std::mutex& mutex, const std::vector<const FontFaceFT*>& faces)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ShapingCache::Stats sum;
+    for (const FontFaceFT* f : faces) {
+        const ShapingCache::Stats s = f->shapingStats();
+        sum.hits += s.hits;
+        sum.misses += s.misses;
+        sum.count += s.count;
+        sum.bytes += s.bytes;
+    }
+    return sum;
+}
+
+static int shaping(const std::string& outDir, size_t iterations)
+{
+    std::mutex facesMutex;
+    std::vector<const FontFaceFT*> faces;
+
+    std::shared_ptr<FontsEngine> engine = makeEngine(outDir + "shaping/");
+    engine->setFontFaceFactory([&facesMutex, &faces](const mu::io::path_t& path) -> IFontFace* {
+        if (mu::io::FileInfo::suffix(path) == u"ftx") {
+            return new FontFaceDU(new FontFaceXT());
+        }
+        return new FontFaceDU(new CountedFaceFT(facesMutex, faces));
+    });
+
+    //! NOTE As layout of a text-heavy score: each text is measured in several ways at several sizes,
+    //! the lyrics syllables and dynamics are repeated on every system
+    auto measurePass = [&]() {
+        size_t calls = 0;
+        for (double size : POINT_SIZES) {
+            for (const FontInfo& fi : TEXT_FONTS) {
+                const Font font = makeFont(fi, size);
+                for (const std::u32string& text : TEXTS) {
+                    engine->horizontalAdvance(font, text);
+                    engine->boundingRect(font, text);
+                    engine->tightBoundingRect(font, text);
+                    calls += 3;
+                }
+            }
+        }
+        return calls;
+    };
+
+    size_t calls = measurePass();
+    const ShapingCache::Stats first = shapingStats(facesMutex, faces);
+
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        calls += measurePass();
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    const ShapingCache::Stats total = shapingStats(facesMutex, faces);
+    const uint64_t shaped = total.hits + total.misses;
+
+    std::cout << "shaping: metrics calls: " << calls << ", texts shaped by the faces: " << shaped
+              << ", hb_shape calls: " << total.misses << " (without the cache: " << shaped << ")"
+              << ", reduction: " << (shaped > 0 ? 100.0 * (1.0 - double(total.misses) / double(shaped)) : 0.0) << "%"
+              << ", cached runs: " << total.count << ", bytes: " << total.bytes
+              << ", warm passes: " << iterations << " in " << sec << " s" << std::endl;
+
+    //! NOTE After the first pass all the texts are cached (the cache is much larger than they are)
+    const bool ok = total.misses == first.misses;
+    if (!ok) {
+        std::cout << "shaping: repeated texts were shaped again: " << (total.misses - first.misses) << std::endl;
+    }
+    return ok ? 0 : 1;
+}
+
+// ================ shaperate ================
+
+static const char* SHAPE_FONT_PATH = ":/fonts/edwin/Edwin-Roman.otf";
+
+static const hb_feature_t SHAPE_FEATURES[] = {
+    { HB_TAG('k', 'e', 'r', 'n'), 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END },
+    { HB_TAG('l', 'i', 'g', 'a'), 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END },
+    { HB_TAG('c', 'l', 'i', 'g'), 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END },
+    { HB_TAG('d', 'l', 'i', 'g'), 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END },
+    { HB_TAG('h', 'l', 'i', 'g'), 1, HB_FEATURE_GLOBAL_START, HB_FEATURE_GLOBAL_END }
+};
+
+static const unsigned int SHAPE_FEATURES_COUNT = sizeof(SHAPE_FEATURES) / sizeof(SHAPE_FEATURES[0]);
+
+static int shaperate(const std::string& outDir, size_t iterations)
+{
+    ByteArray fontData;
+    {
+        mu::io::File file(SHAPE_FONT_PATH);
+        if (!file.open(mu::io::IODevice::ReadOnly)) {
+            LOGE() << "failed open: " << SHAPE_FONT_PATH;
+            return 1;
+        }
+        fontData = file.readAll();
+    }
+
+    hb_blob_t* blob = hb_blob_create(reinterpret_cast<const char*>(fontData.constData()), static_cast<unsigned int>(fontData.size()),
+                                     HB_MEMORY_MODE_READONLY, nullptr, nullptr);
+    hb_face_t* face = hb_face_create(blob, 0);
+    hb_font_t* font = hb_font_create(face);
+
+    const size_t calls = iterations * 20000;
+    uint64_t glyphs = 0;
+
+    auto rate = [calls](const std::chrono::steady_clock::time_point& startTime) {
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        return sec > 0.0 ? calls / sec : 0.0;
+    };
+
+    // before: a new buffer and hb_shape (the plan is looked up by the features) for each call
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i) {
+        const std::u32string& text = TEXTS[i % TEXTS.size()];
+        hb_buffer_t* buffer = hb_buffer_create();
+        hb_buffer_add_utf32(buffer, reinterpret_cast<const uint32_t*>(text.data()), static_cast<int>(text.size()), 0, -1);
+        hb_buffer_guess_segment_properties(buffer);
+        hb_shape(font, buffer, SHAPE_FEATURES, SHAPE_FEATURES_COUNT);
+        glyphs += hb_buffer_get_length(buffer);
+        hb_buffer_destroy(buffer);
+    }
+    const double beforeRate = rate(startTime);
+
+    // after: a reused buffer and the shape plan cached for the segment properties
+    hb_buffer_t* buffer = hb_buffer_create();
+    hb_shape_plan_t* plan = nullptr;
+    hb_segment_properties_t planProps = HB_SEGMENT_PROPERTIES_DEFAULT;
+    startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i) {
+        const std::u32string& text = TEXTS[i % TEXTS.size()];
+        hb_buffer_clear_contents(buffer);
+        hb_buffer_add_utf32(buffer, reinterpret_cast<const uint32_t*>(text.data()), static_cast<int>(text.size()), 0, -1);
+        hb_buffer_guess_segment_properties(buffer);
+
+        hb_segment_properties_t props;
+        hb_buffer_get_segment_properties(buffer, &props);
+        if (!plan || !hb_segment_properties_equal(&props, &planProps)) {
+            hb_shape_plan_destroy(plan);
+            plan = hb_shape_plan_create_cached(face, &props, SHAPE_FEATURES, SHAPE_FEATURES_COUNT, nullptr);
+            planProps = props;
+        }
+
+        hb_shape_plan_execute(plan, font, buffer, SHAPE_FEATURES, SHAPE_FEATURES_COUNT);
+        glyphs += hb_buffer_get_length(buffer);
+    }
+    const double afterRate = rate(startTime);
+
+    hb_shape_plan_destroy(plan);
+    hb_buffer_destroy(buffer);
+    hb_font_destroy(font);
+    hb_face_destroy(face);
+    hb_blob_destroy(blob);
+
+    std::cout << "shaperate: harfbuzz, calls: " << calls << ", new buffer + hb_shape: " << static_cast<size_t>(beforeRate)
+              << " calls/sec, reused buffer + cached plan: " << static_cast<size_t>(afterRate) << " calls/sec"
+              << ", speedup: " << (beforeRate > 0.0 ? afterRate / beforeRate : 0.0)
+              << " (glyphs " << glyphs << ")" << std::endl;
+
+    //! NOTE The engine with the texts that are not in the shaping cache, so each call is shaped
+    {
+        std::shared_ptr<FontsEngine> engine = makeEngine(outDir + "shaperate/");
+        const FontHandle h = engine->resolve(makeFont(TEXT_FONTS.front(), 12.0));
+
+        std::vector<std::u32string> texts;
+        texts.reserve(calls);
+        for (size_t i = 0; i < calls; ++i) {
+            const std::u32string& text = TEXTS[i % TEXTS.size()];
+            std::string n = std::to_string(i);
+            texts.push_back(text + std::u32string(n.begin(), n.end()));
+        }
+
+        double sum = 0.0;
+        startTime = std::chrono::steady_clock::now();
+        for (const std::u32string& text : texts) {
+            sum += engine->horizontalAdvance(h, text);
+        }
+        std::cout << "shaperate: engine, not cached texts: " << static_cast<size_t>(rate(startTime)) << " calls/sec"
+                  << " (checksum " << static_cast<long long>(sum) << ")" << std::endl;
+    }
+
+    return 0;
+}
+
+// ================ allocs ================
+
+//! NOTE The global operator new counts the allocations of the thread, on which the counting is enabled,
+//! the other forms of new and delete (arrays, nothrow, sized) call these ones by default
+static std::atomic<size_t> s_allocsCount(0);
+static thread_local bool s_allocsCounting = false;
+
+void* operator new(std::size_t size)
+{
+    if (s_allocsCounting) {
+        s_allocsCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+static int allocs(const std::string& outDir, size_t iterations)
+{
+    std::shared_ptr<FontsEngine> engine = makeEngine(outDir + "allocs/");
+
+    std::vector<Font> fonts;
+    std::vector<FontHandle> handles;
+    for (const FontInfo& fi : TEXT_FONTS) {
+        for (double pointSize : POINT_SIZES) {
+            fonts.push_back(makeFont(fi, pointSize));
+            handles.push_back(engine->resolve(fonts.back()));
+        }
+    }
+
+    double sum = 0.0;
+    auto measure = [&]() {
+        for (size_t fi = 0; fi < fonts.size(); ++fi) {
+            for (const std::u32string& text : TEXTS) {
+                sum += engine->horizontalAdvance(fonts.at(fi), text);
+                sum += engine->boundingRect(fonts.at(fi), text).width();
+                sum += engine->horizontalAdvance(handles.at(fi), text);
+                sum += engine->boundingRect(handles.at(fi), text).width();
+            }
+        }
+    };
+
+    // warm
+    measure();
+
+    s_allocsCount = 0;
+    s_allocsCounting = true;
+    for (size_t i = 0; i < iterations; ++i) {
+        measure();
+    }
+    s_allocsCounting = false;
+
+    const size_t calls = iterations * fonts.size() * TEXTS.size() * 4;
+    const size_t count = s_allocsCount;
+    std::cout << "allocs: calls: " << calls << ", allocations: " << count
+              << " (checksum " << static_cast<long long>(sum) << ")" << std::endl;
+
+    if (count > 0) {
+        LOGE() << "the warm texts are measured with allocations: " << count;
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cout << "usage: fontsbench <out_dir> [--threads <count>] [--iterations <count>] [stress] [resolve] [shaping] [shaperate] [allocs]" << std::endl;
+        return 1;
+    }
+
+    std::string outDir = argv[1];
+    if (outDir.back() != '/') {
+        outDir += "/";
+    }
+
+    size_t threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t iterations = 10;
+    std::vector<std::string> tests;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threadsCount = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::max(1, std::stoi(argv[++i]));
+        } else {
+            tests.push_back(arg);
+        }
+    }
+
+    if (tests.empty()) {
+        tests = { "stress", "resolve", "shaping", "shaperate", "allocs" };
+    }
+
+    MuseScoreModules::setup();
+
+    int result = 0;
+    for (const std::string& test : tests) {
+        int ret = 0;
+        if (test == "stress") {
+            ret = stress(outDir, threadsCount, iterations);
+        } else if (test == "resolve") {
+            ret = resolve(outDir, iterations);
+        } else if (test == "shaping") {
+            ret = shaping(outDir, iterations);
+        } else if (test == "shaperate") {
+            ret = shaperate(outDir, iterations);
+        } else if (test == "allocs") {
+            ret = allocs(outDir, iterations);
+        } else {
+            std::cout << "unknown test: " << test << std::endl;
+            ret = 1;
+        }
+
+        if (ret != 0) {
+            std::cout << test << " FAILED" << std::endl;
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,284 @@
+//! NOTE Packs resource files into a single uncompressed pack (see resourcespack.h),
+//! that is embedded into the binary with the assembler `.incbin` (no giant array literals to compile)
+//! and is read by ResourcesRegister in place (no inflate, no copies).
+//!
+//! usage: rcpack <name> <out_dir> (--root <dir> <file>... | --qrc <path/name.qrc.cpp>)
+//!
+//! --root - the files are given relative to the dir, they are registered with these paths
+//! --qrc - takes the files from the zip data of the qrc.cpp resource
+//!
+//! Writes <out_dir>/<name>.rcpack, <name>.rc.S (the pack as the data of the binary)
+//! and <name>.rc.cpp (InitResources_<name>, see INIT_RESOURCE)
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "io/ziparchive.hpp"
+#include "resourcespack.h"
+
+using namespace xtz::io;
+
+struct File {
+    std::string dir;
+    std::string name;
+    std::vector<uint8_t> data;
+
+    std::string path() const { return dir.empty() ? name : dir + "/" + name; }
+};
+
+static bool readAll(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.good()) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+static bool writeAll(const std::string& path, const std::string& data)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return out.good();
+}
+
+static File makeFile(const std::string& path, std::vector<uint8_t> data)
+{
+    File f;
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        f.name = path;
+    } else {
+        f.dir = path.substr(0, slash);
+        f.name = path.substr(slash + 1);
+    }
+    f.data = std::move(data);
+    return f;
+}
+
+//! NOTE The data array of the qrc.cpp is the only brace list of numbers after `rc_data_`
+static bool readQrcData(const std::string& qrcPath, std::vector<uint8_t>& zip)
+{
+    std::vector<uint8_t> text;
+    if (!readAll(qrcPath, text)) {
+        std::cerr << "failed read: " << qrcPath << std::endl;
+        return false;
+    }
+
+    const std::string str(text.begin(), text.end());
+    size_t pos = str.find("rc_data_");
+    while (pos != std::string::npos && str.compare(pos, 12, "rc_data_size") == 0) {
+        pos = str.find("rc_data_", pos + 1);
+    }
+    pos = pos == std::string::npos ? pos : str.find('{', pos);
+    if (pos == std::string::npos) {
+        std::cerr << "not found resource data in: " << qrcPath << std::endl;
+        return false;
+    }
+
+    zip.clear();
+    uint32_t value = 0;
+    bool hasValue = false;
+    for (++pos; pos < str.size() && str[pos] != '}'; ++pos) {
+        const char c = str[pos];
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            value = value * 10 + uint32_t(c - '0');
+            hasValue = true;
+        } else if (c == ',') {
+            if (hasValue) {
+                zip.push_back(static_cast<uint8_t>(value));
+            }
+            value = 0;
+            hasValue = false;
+        }
+    }
+    if (hasValue) {
+        zip.push_back(static_cast<uint8_t>(value));
+    }
+
+    return !zip.empty();
+}
+
+//! NOTE The archive is read by ZipArchive, as the zip resources at runtime
+static bool unzip(const std::vector<uint8_t>& zipData, std::vector<File>& files)
+{
+    ZipArchive zip;
+    if (!zip.openData(mu::ByteArray::fromRawData(zipData.data(), zipData.size()))) {
+        std::cerr << "not zip data" << std::endl;
+        return false;
+    }
+
+    for (const ZipArchive::Entry& e : zip.entries()) {
+        std::vector<uint8_t> data(e.size);
+        if (!zip.readInto(e, data.data(), data.size())) {
+            std::cerr << "failed read: " << e.path << std::endl;
+            return false;
+        }
+
+        files.push_back(makeFile(e.path, std::move(data)));
+    }
+
+    return true;
+}
+
+static size_t align(size_t v, size_t a)
+{
+    return (v + a - 1) / a * a;
+}
+
+static std::string makePack(std::vector<File>& files)
+{
+    std::sort(files.begin(), files.end(), [](const File& f1, const File& f2) {
+        return f1.dir != f2.dir ? f1.dir < f2.dir : f1.name < f2.name;
+    });
+
+    std::vector<rcpack::DirEntry> dirs;
+    std::vector<rcpack::FileEntry> entries(files.size());
+    std::string names;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const File& f = files[i];
+        if (dirs.empty() || f.dir != names.substr(dirs.back().pathOffset, dirs.back().pathSize)) {
+            rcpack::DirEntry de;
+            de.pathOffset = static_cast<uint32_t>(names.size());
+            de.pathSize = static_cast<uint32_t>(f.dir.size());
+            de.firstFile = static_cast<uint32_t>(i);
+            names += f.dir;
+            dirs.push_back(de);
+        }
+        dirs.back().filesCount++;
+
+        const std::string path = f.path();
+        entries[i].pathOffset = static_cast<uint32_t>(names.size());
+        entries[i].pathSize = static_cast<uint32_t>(path.size());
+        entries[i].nameSize = static_cast<uint32_t>(f.name.size());
+        names += path;
+    }
+
+    rcpack::Header h;
+    std::memcpy(h.magic, rcpack::MAGIC, sizeof(h.magic));
+    h.version = rcpack::VERSION;
+    h.dirsCount = static_cast<uint32_t>(dirs.size());
+    h.filesCount = static_cast<uint32_t>(entries.size());
+    h.dirsOffset = sizeof(rcpack::Header);
+    h.filesOffset = static_cast<uint32_t>(h.dirsOffset + dirs.size() * sizeof(rcpack::DirEntry));
+    h.namesOffset = static_cast<uint32_t>(h.filesOffset + entries.size() * sizeof(rcpack::FileEntry));
+    h.namesSize = static_cast<uint32_t>(names.size());
+
+    size_t offset = align(size_t(h.namesOffset) + h.namesSize, rcpack::DATA_ALIGN);
+    for (size_t i = 0; i < files.size(); ++i) {
+        entries[i].dataOffset = offset;
+        entries[i].dataSize = files[i].data.size();
+        offset = align(offset + files[i].data.size(), rcpack::DATA_ALIGN);
+    }
+
+    std::string pack(offset, '\0');
+    std::memcpy(&pack[0], &h, sizeof(h));
+    std::memcpy(&pack[h.dirsOffset], dirs.data(), dirs.size() * sizeof(rcpack::DirEntry));
+    std::memcpy(&pack[h.filesOffset], entries.data(), entries.size() * sizeof(rcpack::FileEntry));
+    std::memcpy(&pack[h.namesOffset], names.data(), names.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!files[i].data.empty()) {
+            std::memcpy(&pack[entries[i].dataOffset], files[i].data.data(), files[i].data.size());
+        }
+    }
+
+    return pack;
+}
+
+static std::string makeAsm(const std::string& name, const std::string& packPath)
+{
+    const std::string sym = "xtz_rc_" + name;
+    std::ostringstream out;
+    out << "#if defined(__APPLE__)\n"
+        << "    .const_data\n"
+        << "    .globl _" << sym << "\n"
+        << "    .globl _" << sym << "_end\n"
+        << "    .balign " << rcpack::DATA_ALIGN << "\n"
+        << "_" << sym << ":\n"
+        << "    .incbin \"" << packPath << "\"\n"
+        << "_" << sym << "_end:\n"
+        << "#else\n"
+        << "    .section .rodata." << sym << ",\"a\"\n"
+        << "    .globl " << sym << "\n"
+        << "    .globl " << sym << "_end\n"
+        << "    .balign " << rcpack::DATA_ALIGN << "\n"
+        << sym << ":\n"
+        << "    .incbin \"" << packPath << "\"\n"
+        << sym << "_end:\n"
+        << "    .section .note.GNU-stack,\"\",%progbits\n"
+        << "#endif\n";
+    return out.str();
+}
+
+static std::string makeCpp(const std::string& name)
+{
+    const std::string sym = "xtz_rc_" + name;
+    std::ostringstream out;
+    out << "#include <cstddef>\n#include <cstdint>\n\n"
+        << "extern \"C\" const uint8_t " << sym << "[];\n"
+        << "extern \"C\" const uint8_t " << sym << "_end[];\n\n"
+        << "namespace rc {\n"
+        << "extern void RegisterResourcePack(const uint8_t* data, const size_t dataSize);\n"
+        << "}\n"
+        << "void InitResources_" << name << "() { rc::RegisterResourcePack(" << sym << ", static_cast<size_t>("
+        << sym << "_end - " << sym << ")); }\n";
+    return out.str();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5) {
+        std::cout << "usage: rcpack <name> <out_dir> (--root <dir> <file>... | --qrc <path/name.qrc.cpp>)" << std::endl;
+        return 1;
+    }
+
+    const std::string name = argv[1];
+    std::string outDir = argv[2];
+    if (outDir.back() != '/') {
+        outDir += "/";
+    }
+
+    std::vector<File> files;
+    const std::string mode = argv[3];
+    if (mode == "--qrc") {
+        std::vector<uint8_t> zip;
+        if (!readQrcData(argv[4], zip) || !unzip(zip, files)) {
+            return 1;
+        }
+    } else if (mode == "--root") {
+        std::string root = argv[4];
+        if (root.back() != '/') {
+            root += "/";
+        }
+        for (int i = 5; i < argc; ++i) {
+            std::vector<uint8_t> data;
+            if (!readAll(root + argv[i], data)) {
+                std::cerr << "failed read: " << root + argv[i] << std::endl;
+                return 1;
+            }
+            files.push_back(makeFile(argv[i], std::move(data)));
+        }
+    } else {
+        std::cerr << "unknown input: " << mode << std::endl;
+        return 1;
+    }
+
+    const std::string packPath = outDir + name + ".rcpack";
+    if (!writeAll(packPath, makePack(files))
+        || !writeAll(outDir + name + ".rc.S", makeAsm(name, packPath))
+        || !writeAll(outDir + name + ".rc.cpp", makeCpp(name))) {
+        std::cerr << "failed write: " << outDir << name << std::endl;
+        return 1;
+    }
+
+    std::cout << name << ": " << files.size() << " files, pack: " << packPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,280 @@
+//! NOTE Generates the SDF cache of the bundled fonts, to ship it as a resource
+//! (resources/sdfcache.qrc.cpp, used with XTZ_USE_SDFCACHE_RESOURCE),
+//! so that the first render of a score does not generate SDF at all.
+//!
+//! usage: sdfcachegen <out_dir> [--threads <count>] [--qrc <path/sdfcache.qrc.cpp>] [--msdf <density>] [--bench] [--verify <glyph step>]
+//!
+//! --msdf - generates multi-channel SDF of the given texel density (per em) for all fonts
+//! (the app must set the same params, see IFontsEngine::setSdfParams)
+//! --bench - renders the full Bravura glyph set on 1, 2, 4 ... threads
+//! (each time into an empty cache) and reports glyphs/sec
+//! --verify - compares the SDF of each <glyph step>-th glyph of the bundled fonts
+//! with msdfgen::generateSDF, fails if the difference is more than the tolerance
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "musescoremodules.h"
+
+#include "global/modularity/ioc.h"
+#include "global/io/file.h"
+#include "global/io/buffer.h"
+#include "global/serialization/zipwriter.h"
+
+#include "fonts/internal/fontsengine.hpp"
+#include "fonts/internal/sdfpackfile.hpp"
+
+#include "log.h"
+
+using namespace mu;
+using namespace mu::draw;
+using namespace xtz::fonts;
+
+struct FontInfo {
+    std::string family;
+    Font::Type type = Font::Type::Undefined;
+    bool bold = false;
+    bool italic = false;
+};
+
+//! NOTE Fonts registered in FontsModule::onInit
+static const std::vector<FontInfo> BUNDLED_FONTS = {
+    { "Edwin", Font::Type::Text, false, false },
+    { "Edwin", Font::Type::Text, false, true },
+    { "Edwin", Font::Type::Text, true, false },
+    { "Edwin", Font::Type::Text, true, true },
+    { "Bravura", Font::Type::MusicSymbol },
+    { "Bravura Text", Font::Type::MusicSymbolText },
+    { "Leland", Font::Type::MusicSymbol },
+    { "Leland Text", Font::Type::MusicSymbolText },
+    { "MuseScoreTab", Font::Type::Tablature },
+};
+
+//! NOTE The curves are flattened, so the distance differs a little
+static const int SDF_VERIFY_TOLERANCE = 2;
+
+//! NOTE MSDF keeps the corners sharp, so a smaller range and max size are enough
+static const uint32_t MSDF_RANGE = 4;
+static const uint32_t MSDF_MAX_SIZE = 64;
+
+static const std::string RESOURCE_NAME = "sdfcache";
+static const std::string RESOURCE_FILE = "SDFCache/sdfcache.pack";
+
+static Font makeFont(const FontInfo& fi)
+{
+    Font f;
+    f.setFamily(String::fromStdString(fi.family), fi.type);
+    f.setBold(fi.bold);
+    f.setItalic(fi.italic);
+    return f;
+}
+
+static int verify(FontsEngine* engine, size_t glyphStep)
+{
+    int result = 0;
+    for (const FontInfo& fi : BUNDLED_FONTS) {
+        const FontsEngine::SdfDiff diff = engine->compareSdfWithReference(makeFont(fi), glyphStep);
+
+        const bool ok = diff.maxDiff <= SDF_VERIFY_TOLERANCE;
+        std::cout << fi.family << (fi.bold ? " bold" : "") << (fi.italic ? " italic" : "")
+                  << ": glyphs: " << diff.glyphs << ", max diff: " << diff.maxDiff << ", mean diff: " << diff.meanDiff
+                  << (ok ? "" : " FAILED") << std::endl;
+
+        if (!ok) {
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+static int bench(FontsEngine* engine, const std::string& outDir, size_t maxThreads)
+{
+    const Font font = makeFont({ "Bravura", Font::Type::MusicSymbol });
+
+    std::vector<size_t> threads;
+    for (size_t n = 1; n < maxThreads; n *= 2) {
+        threads.push_back(n);
+    }
+    threads.push_back(maxThreads);
+
+    double baseRate = 0.0;
+    for (size_t n : threads) {
+        //! NOTE Each run starts with an empty cache
+        const std::string dir = outDir + "bench_" + std::to_string(n) + "/";
+        engine->setRenderCacheDirPath(dir);
+        mu::io::File::remove(engine->renderCachePackPath());
+        engine->setWorkersCount(n);
+
+        auto startTime = std::chrono::steady_clock::now();
+        const size_t glyphs = engine->prewarm(font).get();
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        const double rate = sec > 0.0 ? glyphs / sec : 0.0;
+        if (n == 1) {
+            baseRate = rate;
+        }
+
+        std::cout << "threads: " << n << ", glyphs: " << glyphs << ", time: " << sec << " s, "
+                  << "glyphs/sec: " << static_cast<size_t>(rate)
+                  << ", speedup: " << (baseRate > 0.0 ? rate / baseRate : 0.0) << std::endl;
+    }
+
+    return 0;
+}
+
+static bool writeQrc(const mu::io::path_t& packPath, const std::string& qrcPath)
+{
+    ByteArray pack;
+    {
+        mu::io::File file(packPath);
+        if (!file.open(mu::io::IODevice::ReadOnly)) {
+            LOGE() << "failed open: " << packPath;
+            return false;
+        }
+        pack = file.readAll();
+    }
+
+    //! NOTE Resources are registered as zip data (see ResourcesRegister)
+    ByteArray zipData;
+    {
+        mu::io::Buffer buf(&zipData);
+        buf.open(mu::io::IODevice::WriteOnly);
+        ZipWriter zip(&buf);
+        zip.addFile(RESOURCE_FILE, pack);
+        zip.close();
+    }
+
+    std::ofstream out(qrcPath, std::ios::trunc);
+    if (!out.good()) {
+        LOGE() << "failed open: " << qrcPath;
+        return false;
+    }
+
+    out << "#include <string>\n#include <vector>\n\n";
+    out << "namespace rc {\n";
+    out << "static const std::vector<std::string> rc_files_" << RESOURCE_NAME << " = {\n";
+    out << "\"" << RESOURCE_FILE << "\",\n\n";
+    out << "};\n";
+    out << "static const size_t rc_data_size_" << RESOURCE_NAME << " = " << zipData.size() << ";\n";
+    out << "static const uint8_t rc_data_" << RESOURCE_NAME << "[] = {\n";
+    const uint8_t* d = zipData.constData();
+    for (size_t i = 0; i < zipData.size(); ++i) {
+        out << int(d[i]) << ",";
+        if ((i + 1) % 30 == 0) {
+            out << "\n";
+        }
+    }
+    out << "\n};\n";
+    out << "extern void RegisterResourceData(const std::vector<std::string>& files, const uint8_t* data, const size_t dataSize);\n";
+    out << "}\n";
+    out << "void InitResources_" << RESOURCE_NAME << "() { rc::RegisterResourceData(rc::rc_files_" << RESOURCE_NAME
+        << ", &rc::rc_data_" << RESOURCE_NAME << "[0], rc::rc_data_size_" << RESOURCE_NAME << "); }\n";
+
+    return out.good();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cout << "usage: sdfcachegen <out_dir> [--threads <count>] [--qrc <path/sdfcache.qrc.cpp>] [--msdf <density>] [--bench] [--verify <glyph step>]" << std::endl;
+        return 1;
+    }
+
+    std::string outDir = argv[1];
+    if (outDir.back() != '/') {
+        outDir += "/";
+    }
+
+    size_t threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    std::string qrcPath;
+    bool isBench = false;
+    size_t verifyStep = 0;
+    uint32_t msdfDensity = 0;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threadsCount = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--qrc" && i + 1 < argc) {
+            qrcPath = argv[++i];
+        } else if (arg == "--bench") {
+            isBench = true;
+        } else if (arg == "--msdf" && i + 1 < argc) {
+            msdfDensity = static_cast<uint32_t>(std::max(8, std::stoi(argv[++i])));
+        } else if (arg == "--verify" && i + 1 < argc) {
+            verifyStep = std::max(1, std::stoi(argv[++i]));
+        }
+    }
+
+    MuseScoreModules::setup();
+
+    std::shared_ptr<FontsEngine> engine
+        = std::dynamic_pointer_cast<FontsEngine>(mu::modularity::ioc()->resolve<IFontsEngine>("sdfcachegen"));
+    IF_ASSERT_FAILED(engine) {
+        return 1;
+    }
+
+    if (msdfDensity > 0) {
+        SdfParams params;
+        params.format = SdfFormat::Msdf;
+        params.density = msdfDensity;
+        params.range = MSDF_RANGE;
+        params.minSize = 2 * MSDF_RANGE;
+        params.maxSize = MSDF_MAX_SIZE;
+        for (const FontInfo& fi : BUNDLED_FONTS) {
+            engine->setSdfParams(fi.type, params);
+        }
+    }
+
+    if (verifyStep > 0) {
+        return verify(engine.get(), verifyStep);
+    }
+
+    if (isBench) {
+        return bench(engine.get(), outDir, threadsCount);
+    }
+
+    engine->setRenderCacheDirPath(outDir);
+    engine->setWorkersCount(threadsCount);
+    const mu::io::path_t packPath = engine->renderCachePackPath();
+
+    //! NOTE Generate from scratch
+    mu::io::File::remove(packPath);
+
+    auto startTime = std::chrono::steady_clock::now();
+    size_t totalGlyphs = 0;
+
+    for (const FontInfo& fi : BUNDLED_FONTS) {
+        const size_t glyphs = engine->prewarm(makeFont(fi)).get();
+
+        totalGlyphs += glyphs;
+        LOGI() << fi.family << (fi.bold ? " bold" : "") << (fi.italic ? " italic" : "") << ": " << glyphs << " glyphs";
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    LOGI() << "rendered " << totalGlyphs << " glyphs in " << elapsed << " ms, threads: " << threadsCount << ", pack: " << packPath;
+
+    {
+        //! NOTE Reopened, the pack of the engine is not exposed
+        SdfPackFile pack;
+        pack.open(packPath);
+        LOGI() << "sdf images: " << pack.count() << ", bitmaps: " << pack.dataSize() << " bytes";
+    }
+
+    const FontRenderCache::Stats stats = engine->renderCacheStats();
+    LOGI() << "render cache, in memory: " << stats.count << " images, " << stats.bytes << " bytes"
+           << ", evictions: " << stats.evictions << ", misses: " << stats.misses;
+
+    if (!qrcPath.empty()) {
+        if (!writeQrc(packPath, qrcPath)) {
+            return 1;
+        }
+        LOGI() << "resource written: " << qrcPath;
+    }
+
+    return 0;
+}